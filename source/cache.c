@@ -1,11 +1,18 @@
 
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <stdint.h>
 #include <pthread.h>
 #include <unistd.h>
 #include "list.h"
+#include "path_cache.h"
+#include "cache_policy.h"
+#include "pool.h"
 #include <sys/stat.h> //for inode
+#include <sys/mman.h> //for mmap
 // This is just so that I can compile on OSX and it doesn't have sendfile.
 // THE MAKEFILE MUST HAVE -DHAS_SENDFILE TO WORK!!!
 #ifdef HAS_SENDFILE
@@ -25,11 +32,47 @@ typedef int (*cache_close_fptr) (struct cfd*);
 
 /* Structs */
 
+// One of these for every entry in the cache
+struct cache_page {
+	dev_t device;         // The file system the file is on; inode numbers are only unique within one
+	ino_t inode;          // The unique identifier of the file (My understanding that inodes identify files even if not in same path)
+	int ref_count;        // How many people are currently using the file (for garbage collection), changed atomically
+	int file_size;
+	struct timespec mtime; // When the file was last changed; with the size, tells if the page is out of date
+	struct policy_entry entry; // What the replacement policy knows of the page; it picks victims among the pages with ref_count 0
+	char* data;           // Points to the memory that holds the contents of the file
+	int mapped;           // 1 if data is a read-only mmap of the file, 0 if it was malloc'ed
+	struct ilist_link link; // in cache_page_list
+};
+
+
+//One of these for every client - will point to a cache page. Keeps track of where the client is in the file
+struct file_cached {
+	int position;                   // How many bytes have we written so far
+	struct cache_page* cache_page;  // The pointer to the cache page the cfd has open
+};
+
+
+//File open from disk, not copied into cache
+struct file_not_cached {
+	FILE *open_ptr; // The open file, only used for its descriptor
+	off_t position; // How many bytes have we sent so far, passed to sendfile explicitly
+	int file_size;
+};
+
+
 // Every client gets a cfd
 struct cfd {
 	int id;           //The ID of the client
 	void* interface;  //points to either a file_cached or a file_uncached
 	int taken;        // boolean; if this space is taken by a client
+	int generation;   // bumped every time the cfd is freed, so that an old handle to it stops working
+	int next_free;    // id+1 of the next cfd on the free list, 0 for the last one
+	int hit;          // boolean; if the file was already cached when it was opened
+	union {           // what interface points to, kept here so that opening allocates nothing
+		struct file_cached cached;
+		struct file_not_cached not_cached;
+	} file;
 	//function pointers
 	cache_filesize_fptr filesize_ptr;
 	cache_send_fptr send_ptr;
@@ -37,73 +80,169 @@ struct cfd {
 };
 
 
-// Holds the vector of cfds
+// Holds the cfds, in chunks that never move once allocated, so that a client can use its
+// cfd without any lock: nobody else touches it between cache_open and cache_close
+#define CFD_CHUNK 256   // cfds per chunk
+#define CFD_CHUNKS 4096 // chunks at most, about a million clients
+
+// A handle is the cfd's id, with the low bits of its generation above it. The generation
+// wraps after 2048 reuses of one cfd; a handle kept that long would be found again.
+#define CFD_ID_BITS 20  // CFD_CHUNK*CFD_CHUNKS ids
+#define CFD_GEN_MASK ((1 << (31-CFD_ID_BITS)) - 1) // handles stay positive, -1 is an error
+
 struct client_mgr {
-  int client_size;     // How many clients we currently have
-  struct cfd* clients; // The vector of clients
+	struct cfd* chunks[CFD_CHUNKS];
+	int num_chunks;          // read without the lock, so only raised once the chunk is ready
+	int open;                // cfds taken, and the most there ever were; changed atomically
+	int peak;
+	uint64_t free_list;      // id+1 of the first free cfd, and a count of changes in the top half so
+	                         // that compare-and-swap can't mistake a cfd taken and freed again for no change
+	pthread_mutex_t grow_mu; // only taken to add a chunk
 };
 
 
-// One of these for every entry in the cache
-struct cache_page {
-	ino_t inode;          // The unique identifier of the file (My understanding that inodes identify files even if not in same path)
-	int ref_count;        // How many people are currently using the file (for garbage collection)
-	int file_size;
-	time_t last_use;      // The last time anyone called close on the file - will be used to determine last use & hence priority in the cache when space is needed
-	char* data;           // Points to the memory that holds the contents of the file
-};
 
+// Index of the cache pages by (device, inode): an open-addressing hash table with linear probing
+#define PAGE_INDEX_MIN 64 // starting number of slots, always a power of 2
+#define CACHE_SHARDS 16   // separately locked parts of the index, a power of 2
+#define PAGE_POOL_MAX 4096 // cache_pages allocated up front at most
 
-//One of these for every client - will point to a cache page. Keeps track of where the client is in the file
-struct file_cached {
-	int position;                   // How many bytes have we written so far
-	struct cache_page* cache_page;  // The pointer to the cache page the cfd has open
+struct page_index {
+	struct cache_page** slots; // NULL marks an empty slot
+	int capacity;
+	int count;                 // kept at most half the capacity so probes stay short
 };
 
-
-//File open from disk, not copied into cache
-struct file_not_cached {
-	FILE *open_ptr; // Keeps track of where they're reading in the file and when we reach the file end
-	int file_size;
+// A page belongs to the shard picked by the top bits of its hash
+struct cache_shard {
+	pthread_mutex_t mu;        // covers the index, and ref_count going to or from 0 for its pages
+	struct page_index index;
 };
 
 
+// How well the policy does: a hit is a file opened while it was cached. Counted atomically
+struct cache_stats {
+	long requests;
+	long hits;
+	long long bytes_requested;
+	long long bytes_hit;
+	long loads;       // pages read in, evicted, and dropped for being out of date
+	long evictions;
+	long stale_drops;
+};
+
 
 // The manager of everything - our cache
+// Opening a cached file only locks its shard, and sending or closing locks nothing unless the
+// page's last client leaves. cache_mu is needed to change what is cached; when a shard is
+// locked too, cache_mu is always taken first.
 struct cache {
-	pthread_mutex_t cache_mu;               
+	pthread_mutex_t cache_mu;               // covers the policy, the byte counts and cache_page_list
+	pthread_mutex_t path_mu;                // covers the path cache
 	struct client_mgr client_mgr;
-	struct link_list* cache_page_list;
-	struct link_list* not_cached_list;
-	struct link_list* cached_list;
+	struct ilist cache_page_list;          // every page, whether in the index or out of date
+	struct pool* page_pool;                 // where the cache_pages come from
+	struct cache_shard shards[CACHE_SHARDS]; // find the pages in cache_page_list
+	struct cache_policy* policy;            // picks the pages to evict
+	struct frequency_sketch* sketch;        // TinyLFU admission filter, NULL to admit every file that fits
+	struct cache_stats stats;
 	int max_bytes_size;
+	int bytes_used;       // file_size summed over cache_page_list
+	int bytes_freeable;   // file_size summed over the pages the policy may evict
+	int use_mmap;         // back new pages with mmap instead of malloc+fread
 };
 
-// This will only be used for the list that contains cache_pages (aka cache_page_list)
-// Needs the extra step to free the memory it references
-static void page_dtor(void* p)
+static struct cache cache;
+
+// Frees the contents of a page, however they were loaded
+static void unload_page(struct cache_page* page)
+{
+	if(page->mapped)
+	{
+		munmap(page->data,page->file_size);
+	}
+	else
+	{
+		free(page->data);
+	}
+	page->data=NULL;
+	page->mapped=0;
+}
+
+// Frees a page and the memory it references, once it is out of cache_page_list
+// Pages are only removed once ref_count is 0, so nobody is still sending from a mapping
+static void free_page(struct cache_page* page)
 {
-	struct cache_page* page = p;
-	free(page->data);
-	free(page);
+	unload_page(page);
+	pool_free(cache.page_pool,page);
 }
 
 /* Set up */
 
-static struct cache cache;
+static struct cache_shard* shard_of(dev_t device, ino_t inode);
+static struct cache_page** index_slot(struct page_index* index, dev_t device, ino_t inode);
+static void release_page(struct cache_page* page);
+static void drop_page(struct cache_page* page, int evicted);
+static void free_cfd(struct cfd* cfd);
 
 // Initializes the above structures
-void cache_init(int size) //Maybe should return a number
+int cache_init(int size, const char *policy)
 {
+  char name[16];
+  int len;
+  int i;
+  int pages;
+
+  //A policy name, optionally with +tinylfu for the admission filter; tinylfu alone filters for lru
+  if(!policy) policy = "lru";
+  len = strlen(policy);
+  if(len >= (int)sizeof(name)) return -1;
+  strcpy(name,policy);
+  cache.sketch = NULL;
+  if(len >= 8 && strcmp(name+len-8,"+tinylfu") == 0) name[len-8] = '\0';
+  else if(strcmp(name,"tinylfu") == 0) strcpy(name,"lru");
+  if(strcmp(name,policy) != 0)
+  {
+    cache.sketch = sketch_create(size/4096); //about one counter per page of an average size
+    if(!cache.sketch) return -1;
+  }
+  cache.policy = policy_create(name,size);
+  if(!cache.policy)
+  {
+    sketch_destroy(cache.sketch);
+    return -1;
+  }
+
   pthread_mutex_init(&cache.cache_mu,NULL);
+  pthread_mutex_init(&cache.path_mu,NULL);
   cache.max_bytes_size = size; // starting cache size
-  
-  cache.client_mgr.client_size = 1; // 1 item in the list of clients to start
-  cache.client_mgr.clients = calloc(sizeof(struct cfd),cache.client_mgr.client_size); //allocate's memory for 1 client and sets all values to 0
-  
-  cache.not_cached_list=link_list_init(free); //so when you want to get rid of a node / the whole linked list it'll just free the memory
-  cache.cached_list=link_list_init(free);
-  cache.cache_page_list=link_list_init(page_dtor);
+
+  memset(&cache.client_mgr,0,sizeof(cache.client_mgr)); // no cfds until the first open adds a chunk
+  pthread_mutex_init(&cache.client_mgr.grow_mu,NULL);
+
+  ilist_init(&cache.cache_page_list);
+  pages = size/4096; //about as many as fit, for pages of an average size
+  cache.page_pool=pool_create("cache pages",sizeof(struct cache_page),pages < PAGE_POOL_MAX ? pages : PAGE_POOL_MAX);
+  if(!cache.page_pool) return -1;
+
+  for(i = 0; i < CACHE_SHARDS; i++)
+  {
+    pthread_mutex_init(&cache.shards[i].mu,NULL);
+    cache.shards[i].index.capacity = PAGE_INDEX_MIN;
+    cache.shards[i].index.count = 0;
+    cache.shards[i].index.slots = calloc(sizeof(struct cache_page*),PAGE_INDEX_MIN);
+  }
+
+  cache.bytes_used = cache.bytes_freeable = 0;
+  memset(&cache.stats,0,sizeof(cache.stats));
+  return 0;
+}
+
+
+
+void cache_use_mmap(int enable)
+{
+  cache.use_mmap = enable;
 }
 
 
@@ -125,6 +264,7 @@ static int filesize_v_not_cached(struct cfd* client)
 }
 
 
+// No lock: the page can't be evicted or changed while this client holds a reference to it
 static int send_v_cached(struct cfd* client, int client_fd, int n_bytes)
 {
 	struct file_cached* p = (struct file_cached*) client->interface;
@@ -134,10 +274,8 @@ static int send_v_cached(struct cfd* client, int client_fd, int n_bytes)
 	if( bytes_left < n_bytes ) {
 		n_bytes = bytes_left;
 	}
-	pthread_mutex_unlock( &cache.cache_mu );
 	actually_written = write( client_fd, src, n_bytes );
-	pthread_mutex_lock( &cache.cache_mu );
-	
+
 	if( -1 == actually_written ) {
 		return -1;
 	}
@@ -149,35 +287,54 @@ static int send_v_cached(struct cfd* client, int client_fd, int n_bytes)
 
 static int send_v_not_cached(struct cfd* client, int client_fd, int n_bytes)
 {
-	//Unlocked for performance but there's no danger here - mix of local variables and variables owned by the one thread
+	//No lock needed - mix of local variables and variables owned by the one thread
 	struct file_not_cached* p = (struct file_not_cached*) client->interface; //up to the caller to know how many bytes is left in the file
 	int our_fd = fileno(p->open_ptr); //Converts a FILE* into a file descriptor which we then pass to sendfile
 	if(our_fd == -1) return -1;
 	int ret = -1; // This is to catch the HAS_SENDFILE case below
-	// Unlock so that other threads can send in parallel
-	pthread_mutex_unlock( &cache.cache_mu );
+	off_t position = p->position;
 	// Instead of calling write() which would require a bunch of extra steps, we're using sendfile()
 	#ifdef HAS_SENDFILE
-		ret = sendfile(client_fd,our_fd,NULL,n_bytes); //This reads n bytes from one file descriptor (our_fd) into the other (client_fd)
+		ret = sendfile(client_fd,our_fd,&position,n_bytes); //This reads n bytes from one file descriptor (our_fd) into the other (client_fd), starting at position
 	#endif
-	// Re-lock before returning otherwise the unlock higher up won't make sense
-	pthread_mutex_lock( &cache.cache_mu );
+	p->position = position; //sendfile moved it past the bytes it sent
 	return ret;
 }
 
 
+// Drops the client's reference to the page. Only the last one takes the locks, as it
+// may have to free the page or hand it to the policy
+static void unref_page(struct cache_page* page)
+{
+	int ref = __atomic_load_n(&page->ref_count,__ATOMIC_RELAXED);
+	while(ref > 1)
+	{
+		if(__atomic_compare_exchange_n(&page->ref_count,&ref,ref-1,1,__ATOMIC_RELEASE,__ATOMIC_RELAXED)) return;
+	}
+
+	struct cache_shard* shard = shard_of(page->device,page->inode);
+	pthread_mutex_lock(&cache.cache_mu);
+	pthread_mutex_lock(&shard->mu);
+	if(__atomic_sub_fetch(&page->ref_count,1,__ATOMIC_ACQ_REL)==0)
+	{
+		//A page that went out of date is no longer in the index, nobody else can use it
+		if(*index_slot(&shard->index,page->device,page->inode)!=page) drop_page(page,0);
+		else release_page(page);
+	}
+	pthread_mutex_unlock(&shard->mu);
+	pthread_mutex_unlock(&cache.cache_mu);
+}
+
 static int close_v_cached(struct cfd* client)
 {
-    struct file_cached* p = (struct file_cached*) client-> interface;
+	struct file_cached* p = (struct file_cached*) client-> interface;
 
 	//Reset state
 	client->taken=0;
 
-	//Decrement refcount, and update last time used
-	p->cache_page->ref_count--;
-	p->cache_page->last_use = time( NULL );
-
-	link_list_remove(cache.cached_list,p);
+	//Decrement refcount, and once nobody uses the page make it the newest in the LRU list
+	unref_page(p->cache_page);
+	free_cfd(client);
 	return 0;
 }
 
@@ -188,265 +345,455 @@ static int close_v_not_cached(struct cfd* client)
 
 	//Reset state
 	client->taken=0;
-	link_list_remove(cache.not_cached_list,p);
+	free_cfd(client);
 
 	return 0;
 }
 
-static int load_page(char* file, int file_size, struct cache_page* page)
+// Maps the file read-only instead of copying it. The kernel page cache then holds the only
+// copy, and the miss does not read the file while holding cache_mu: MADV_WILLNEED starts
+// reading it in the background, and whatever is not in yet is faulted in by the send.
+static int map_page(FILE* f, int file_size, struct cache_page* page)
+{
+	void* data = mmap(NULL,file_size,PROT_READ,MAP_PRIVATE,fileno(f),0);
+	if(data == MAP_FAILED) return 0;
+
+	madvise(data,file_size,MADV_SEQUENTIAL); // clients read it front to back
+	madvise(data,file_size,MADV_WILLNEED);
+	page->data=data;
+	page->mapped=1;
+	return 1;
+}
+
+// Returns 1 if loaded, 0 if not, or -1 if the file is no longer what info says it is
+static int load_page(char* file, const struct path_info* info, struct cache_page* page)
 {
 	struct stat stat;
 	FILE* f = fopen(file,"rb");
 	if(!f) return 0;
-	page->file_size=file_size;
-	page->data = malloc(file_size);
-	if(!page->data)
+
+	//The page must be of the file that was opened: mapping it at a size it no longer has
+	//would fault past its end
+	if(fstat(fileno(f),&stat)!=0)
 	{
 		fclose(f);
 		return 0;
 	}
-
-	if(fread(page->data,file_size,1,f) != 1)
+	if(stat.st_dev!=info->device || stat.st_ino!=info->inode || stat.st_size!=info->size ||
+	   stat.st_mtim.tv_sec!=info->mtime.tv_sec || stat.st_mtim.tv_nsec!=info->mtime.tv_nsec)
 	{
-		free(page->data);
-		page->data=NULL;
 		fclose(f);
-		return 0;
+		return -1;
 	}
-	if(fstat(fileno(f),&stat)!=0)
+	int file_size = stat.st_size;
+	page->file_size=file_size;
+	page->mapped=0;
+	if(cache.use_mmap && file_size > 0) //an empty file can't be mapped
 	{
-		free(page->data);
-		page->data=NULL;
-		fclose(f);
-		return 0;
+		if(!map_page(f,file_size,page))
+		{
+			fclose(f);
+			return 0;
+		}
+	}
+	else
+	{
+		page->data = malloc(file_size ? file_size : 1); //malloc(0) may return NULL
+		if(!page->data)
+		{
+			fclose(f);
+			return 0;
+		}
+
+		if(file_size && fread(page->data,file_size,1,f) != 1)
+		{
+			unload_page(page);
+			fclose(f);
+			return 0;
+		}
 	}
+	page->device=stat.st_dev;
 	page->inode=stat.st_ino;
+	page->mtime=stat.st_mtim;
 	fclose(f);
-	page->last_use=0;
 	page->ref_count=1;
-
-	printf("File of size %d cached.\n",file_size);
+	__atomic_add_fetch(&cache.stats.loads,1,__ATOMIC_RELAXED);
 	return 1;
 }
 
 
-static struct cache_page* add_to_cache(char* file,int file_size)
-{
-	struct cache_page* temp = calloc(sizeof(struct cache_page),1);
-	if(!temp) return NULL;
+/* CFD TABLE */
 
-	if(!link_list_add_front(cache.cache_page_list,temp))
-	{
-		free(temp);
-		return NULL;
-	}
 
-	if(!load_page(file,file_size,temp))
-	{
-		link_list_remove(cache.cache_page_list,temp);
-		return NULL;
-	}
+static struct cfd* cfd_at(int id)
+{
+	return &cache.client_mgr.chunks[id/CFD_CHUNK][id%CFD_CHUNK];
+}
 
-	return temp;
+static int cfd_handle(struct cfd* cfd)
+{
+	return (cfd->generation & CFD_GEN_MASK) << CFD_ID_BITS | cfd->id;
 }
 
+// Returns the open cfd the handle was given out for, or NULL if it was closed since
+static struct cfd* find_cfd(int handle)
+{
+	int id = handle & ((1 << CFD_ID_BITS) - 1);
+	if(handle < 0 || id >= __atomic_load_n(&cache.client_mgr.num_chunks,__ATOMIC_ACQUIRE)*CFD_CHUNK) return NULL;
 
-static int setup_not_cached_file(struct cfd* cfd,char *file, int file_size,struct file_not_cached* fnc)
+	struct cfd* cfd = cfd_at(id);
+	int generation = __atomic_load_n(&cfd->generation,__ATOMIC_ACQUIRE);
+	if(((generation & CFD_GEN_MASK) << CFD_ID_BITS | id) != handle) return NULL;
+	return cfd->taken ? cfd : NULL; //a handle that was never given out
+}
+
+// Puts the cfd on the free list
+static void push_cfd(struct cfd* cfd)
 {
-	FILE* f = fopen(file,"rb");
-	if(!f) return -1;
-	fnc->open_ptr = f;
-	fnc->file_size=file_size;
+	struct client_mgr* mgr = &cache.client_mgr;
+	uint64_t head = __atomic_load_n(&mgr->free_list,__ATOMIC_RELAXED);
+	uint64_t next;
+	__atomic_add_fetch(&cfd->generation,1,__ATOMIC_RELEASE);
+	do
+	{
+		__atomic_store_n(&cfd->next_free,(int)(head & 0xffffffff),__ATOMIC_RELAXED);
+		next = ((head >> 32) + 1) << 32 | (uint64_t)(cfd->id+1);
+	} while(!__atomic_compare_exchange_n(&mgr->free_list,&head,next,1,__ATOMIC_RELEASE,__ATOMIC_RELAXED));
+}
 
-	cfd->interface=fnc; //points to the "file"
-	cfd->filesize_ptr=filesize_v_not_cached; //so when file_size function is called, it will go to the version designed for not cached files
-	cfd->taken=1;
+// Takes a cfd off the free list, or returns NULL if it is empty
+static struct cfd* pop_free_cfd()
+{
+	struct client_mgr* mgr = &cache.client_mgr;
+	uint64_t head = __atomic_load_n(&mgr->free_list,__ATOMIC_ACQUIRE);
+	uint64_t next;
+	struct cfd* cfd;
+	do
+	{
+		int first = head & 0xffffffff;
+		if(!first) return NULL;
+		cfd = cfd_at(first-1);
+		//If another thread took cfd meanwhile, this is stale but the count in head changed too
+		next = ((head >> 32) + 1) << 32 | (uint32_t)__atomic_load_n(&cfd->next_free,__ATOMIC_RELAXED);
+	} while(!__atomic_compare_exchange_n(&mgr->free_list,&head,next,1,__ATOMIC_ACQUIRE,__ATOMIC_ACQUIRE));
+	return cfd;
+}
 
-	cfd->send_ptr=send_v_not_cached; //not cached version of send
+// Adds a chunk of free cfds, unless another thread just did. Returns 0 if out of memory or cfds
+static int add_cfd_chunk()
+{
+	struct client_mgr* mgr = &cache.client_mgr;
+	int ret = 1;
+	int i;
 
-	cfd->close_ptr=close_v_not_cached; //not cached version of close
-	return cfd->id;
+	pthread_mutex_lock(&mgr->grow_mu);
+	if((__atomic_load_n(&mgr->free_list,__ATOMIC_ACQUIRE) & 0xffffffff) == 0)
+	{
+		int n = mgr->num_chunks;
+		struct cfd* chunk = n < CFD_CHUNKS ? calloc(sizeof(struct cfd),CFD_CHUNK) : NULL;
+		if(!chunk) ret = 0;
+		else
+		{
+			for(i = 0; i < CFD_CHUNK; i++) chunk[i].id = n*CFD_CHUNK+i;
+			mgr->chunks[n] = chunk;
+			__atomic_store_n(&mgr->num_chunks,n+1,__ATOMIC_RELEASE);
+			for(i = CFD_CHUNK-1; i >= 0; i--) push_cfd(&chunk[i]); //lowest ids come off first
+		}
+	}
+	pthread_mutex_unlock(&mgr->grow_mu);
+	return ret;
 }
 
-static int setup_cached_file(struct cfd* cfd, char *file, int file_size, struct file_cached* fc)
+static struct cfd* alloc_cfd()
 {
-	fc->cache_page = add_to_cache(file,file_size);
-	if(!fc->cache_page) return -1;
+	struct client_mgr* mgr = &cache.client_mgr;
+	struct cfd* cfd;
+	while(!(cfd = pop_free_cfd()))
+	{
+		if(!add_cfd_chunk()) return NULL;
+	}
 
-	fc->position = 0;
+	int open = __atomic_add_fetch(&mgr->open,1,__ATOMIC_RELAXED);
+	int peak = __atomic_load_n(&mgr->peak,__ATOMIC_RELAXED);
+	while(open > peak && !__atomic_compare_exchange_n(&mgr->peak,&peak,open,1,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+	return cfd;
+}
 
-	cfd->interface=fc; //points to the "file"
-	cfd->filesize_ptr=filesize_v_cached; //so when file_size function is called, it will go to the version designed for not cached files
-	cfd->taken=1;
+static void free_cfd(struct cfd* cfd)
+{
+	__atomic_sub_fetch(&cache.client_mgr.open,1,__ATOMIC_RELAXED);
+	push_cfd(cfd);
+}
 
-	cfd->send_ptr=send_v_cached; //not cached version of send
 
-	cfd->close_ptr=close_v_cached; //not cached version of close
+/* PAGE INDEX */
 
-	return cfd->id;
+
+static uint64_t page_hash(dev_t device, ino_t inode)
+{
+	uint64_t h = (uint64_t)inode * 0x9E3779B97F4A7C15ULL ^ (uint64_t)device;
+	h ^= h >> 31;
+	h *= 0xBF58476D1CE4E5B9ULL; // mix so that consecutive inodes spread out
+	h ^= h >> 29;
+	return h;
 }
 
+// The low bits of the hash pick the slot, so the top ones pick the shard
+static struct cache_shard* shard_of(dev_t device, ino_t inode)
+{
+	return &cache.shards[(page_hash(device,inode) >> 56) & (CACHE_SHARDS-1)];
+}
 
-static int open_not_cached(struct cfd* cfd, char *file,int file_size)
+// Returns the slot holding the page for (device, inode), or the empty slot where it would go
+static struct cache_page** index_slot(struct page_index* index, dev_t device, ino_t inode)
 {
-	struct file_not_cached* temp = calloc(sizeof(struct file_not_cached),1); //get memory needed to add file
-	if(!temp) return -1;
+	unsigned int mask = index->capacity-1;
+	unsigned int i = page_hash(device,inode) & mask;
 
-	if(!link_list_add_front(cache.not_cached_list,temp))
+	while(index->slots[i] && (index->slots[i]->device != device || index->slots[i]->inode != inode))
 	{
-		free(temp);
-		return -1;
+		i = (i+1) & mask;
 	}
-
-	return setup_not_cached_file(cfd,file,file_size,temp); //return -1 if unsuccessful
+	return &index->slots[i];
 }
 
-static int open_cached(struct cfd* cfd, char *file,int file_size)
+// Doubles the table and puts every page back in. Returns 1 if successful, 0 if out of memory
+static int index_grow(struct page_index* index)
 {
+	struct cache_page** old = index->slots;
+	int old_capacity = index->capacity;
+	int i;
 
-	struct file_cached* temp = calloc(sizeof(struct file_cached),1);
-	if (!temp) return -1;
-
-	if(!link_list_add_front(cache.cached_list,temp))
+	index->slots = calloc(sizeof(struct cache_page*),old_capacity*2);
+	if(!index->slots)
 	{
-		free(temp);
-		return -1;
+		index->slots = old;
+		return 0;
 	}
-
-	int cfd_id = setup_cached_file(cfd,file,file_size,temp);
-	if (cfd_id == -1)
+	index->capacity = old_capacity*2;
+	for(i = 0; i < old_capacity; i++)
 	{
-		link_list_remove(cache.cached_list,temp);
-		return -1;
+		if(old[i]) *index_slot(index,old[i]->device,old[i]->inode) = old[i];
 	}
-	return cfd_id;
+	free(old);
+	return 1;
 }
 
-
-static unsigned int find_by_inode( void* context, void* item ) //to pass to our link_list_find method to let it know when it has found what it's looking for
+// Returns 1 if successful, 0 if out of memory
+static int index_insert(struct page_index* index, struct cache_page* page)
 {
-	ino_t* looking_for = context;
-	struct cache_page* page = item;
-
-	return *looking_for == page->inode;
+	if((index->count+1)*2 > index->capacity && !index_grow(index)) return 0;
+	*index_slot(index,page->device,page->inode) = page;
+	index->count++;
+	return 1;
 }
 
-static struct cache_page* find_in_cache(char* file)
+// Removes a page, moving back any page after it that would no longer be found past the hole
+static void index_remove(struct page_index* index, struct cache_page* page)
 {
-	struct stat s;
-	if(-1 == stat(file,&s)) return NULL;
-
-	ino_t id = s.st_ino;
-	return link_list_find(cache.cache_page_list,find_by_inode,&id); //Will keep calling find_by_inode until it finds what it's looking for or reach end (return NULL)
-
+	unsigned int mask = index->capacity-1;
+	struct cache_page** slot = index_slot(index,page->device,page->inode);
+	unsigned int hole = slot - index->slots;
+	unsigned int i = hole;
+	unsigned int home;
+
+	if(*slot != page) return; //not in the index
+	index->slots[hole] = NULL;
+	index->count--;
+	while(1)
+	{
+		i = (i+1) & mask;
+		if(!index->slots[i]) break;
+		home = page_hash(index->slots[i]->device,index->slots[i]->inode) & mask;
+		if(((i-home) & mask) >= ((i-hole) & mask)) //the hole is on its probe path
+		{
+			index->slots[hole] = index->slots[i];
+			index->slots[i] = NULL;
+			hole = i;
+		}
+	}
 }
 
-static int join(struct cfd* cfd, struct cache_page* cp)
-{
-	//Link the cfd to the file that's already cached using fc
-	//Return the id of the cfd, or -1 if error
-	struct file_cached* temp = calloc(sizeof(struct file_cached),1);
-	if(!temp) return -1;
 
-	if(!link_list_add_front(cache.cached_list,temp))
-	{
-		free(temp);
-		return -1;
-	}
+/* REPLACEMENT */
+// All of these are called with cache_mu and the page's shard locked
 
-	temp->position=0; //redundant but explicit
-	temp->cache_page = cp;
-	cp->ref_count++;
-	cfd->close_ptr = close_v_cached;
-	cfd->filesize_ptr = filesize_v_cached;
-	cfd->send_ptr = send_v_cached;
-	cfd->interface = temp;
-	cfd->taken=1;
 
-	return cfd->id;
+static struct cache_page* page_of(struct policy_entry* entry)
+{
+	return (struct cache_page*)((char*)entry - offsetof(struct cache_page,entry));
+}
+
+// Takes the page off the policy's lists: it is open, or about to be dropped
+static void acquire_page(struct cache_page* page)
+{
+	if(!page->entry.linked) return; //not released, or the policy couldn't take it when it was
+	cache.policy->acquire_ptr(cache.policy,&page->entry);
+	cache.bytes_freeable-=page->file_size;
 }
 
-static void count_bytes( void* context, void* item )
+// Called when the last client closes the page: it may be evicted from now on.
+// Opening a cached page only locks its shard, so the policy hears of it here: a
+// page still linked was opened and closed again since it was last released.
+static void release_page(struct cache_page* page)
 {
-	int* counter = context;
-	struct cache_page* cp = item;
+	acquire_page(page);
+	if(page->entry.hits > 1) cache.policy->hit_ptr(cache.policy,&page->entry);
+	cache.policy->release_ptr(cache.policy,&page->entry);
+	if(page->entry.linked) cache.bytes_freeable+=page->file_size;
+}
 
-	*counter+=cp->file_size;
+// Frees a page nobody has open. evicted is 0 if it is dropped for being out of date
+static void drop_page(struct cache_page* page, int evicted)
+{
+	__atomic_add_fetch(evicted ? &cache.stats.evictions : &cache.stats.stale_drops,1,__ATOMIC_RELAXED);
+	index_remove(&shard_of(page->device,page->inode)->index,page);
+	if(page->entry.linked) cache.bytes_freeable-=page->file_size;
+	cache.policy->remove_ptr(cache.policy,&page->entry,evicted);
+	cache.bytes_used-=page->file_size;
+	ilist_remove(&cache.cache_page_list,&page->link);
+	free_page(page);
 }
 
-static void count_freeable( void* context, void* item )
+
+// Called with cache_mu locked; locks the shard to add the page to the index.
+// Sets *changed to 1 if the file changed since info was resolved
+static struct cache_page* add_to_cache(char* file,const struct path_info* info,int* changed)
 {
-	int* counter = context;
-	struct cache_page* cp = item;
+	struct cache_page* temp = pool_alloc(cache.page_pool);
+	if(!temp) return NULL;
+	memset(temp,0,sizeof(struct cache_page));
 
-	if(!cp->ref_count)
+	int loaded = load_page(file,info,temp);
+	if(loaded != 1)
 	{
-		*counter+=cp->file_size;
+		*changed = loaded == -1;
+		pool_free(cache.page_pool,temp);
+		return NULL;
 	}
+	int file_size = temp->file_size;
+	temp->entry.key=page_hash(temp->device,temp->inode);
+	temp->entry.size=file_size;
+	temp->entry.hits=1;
+
+	//Other clients can open the page from here on, but only release it after we unlock cache_mu
+	struct cache_shard* shard = shard_of(temp->device,temp->inode);
+	pthread_mutex_lock(&shard->mu);
+	int inserted = index_insert(&shard->index,temp);
+	pthread_mutex_unlock(&shard->mu);
+	if(!inserted)
+	{
+		free_page(temp);
+		return NULL;
+	}
+	ilist_add_front(&cache.cache_page_list,&temp->link);
+	cache.bytes_used+=file_size;
+	cache.policy->insert_ptr(cache.policy,&temp->entry);
+
+	return temp;
 }
 
-static unsigned int find_first_freeable( void* context, void* item )
+
+// The size is the one of the file opened, which may have changed since its path was resolved
+static int open_not_cached(struct cfd* cfd, char *file)
 {
-	struct cache_page* cp = item;
+	struct file_not_cached* fnc = &cfd->file.not_cached;
+	struct stat stat;
+	FILE* f = fopen(file,"rb");
+	if(!f) return -1;
+	if(fstat(fileno(f),&stat)!=0 || !S_ISREG(stat.st_mode) || stat.st_size > INT_MAX)
+	{
+		fclose(f);
+		return -1;
+	}
+	fnc->open_ptr = f;
+	fnc->position = 0;
+	fnc->file_size=stat.st_size;
 
-	return cp->ref_count==0;
-}
+	cfd->interface=fnc; //points to the "file"
+	cfd->filesize_ptr=filesize_v_not_cached; //so when file_size function is called, it will go to the version designed for not cached files
+	cfd->taken=1;
 
-static void calc_oldest_time( void* context, void* item )
-{
-	time_t* oldest = context;
-	struct cache_page* cp = item;
+	cfd->send_ptr=send_v_not_cached; //not cached version of send
 
-	if (cp->last_use < *oldest) *oldest=cp->last_use;
+	cfd->close_ptr=close_v_not_cached; //not cached version of close
+	return cfd_handle(cfd);
 }
 
-static unsigned int find_oldest_page( void* context, void* item)
+static int join(struct cfd* cfd, struct cache_page* cp)
 {
-	time_t* oldest = context;
-	struct cache_page* cp = item;
+	//Link the cfd to the page it holds a reference to
+	//Return the handle of the cfd
+	struct file_cached* fc = &cfd->file.cached;
+	fc->position=0;
+	fc->cache_page = cp;
 
-	return cp->last_use==*oldest;
+	cfd->close_ptr = close_v_cached;
+	cfd->filesize_ptr = filesize_v_cached;
+	cfd->send_ptr = send_v_cached;
+	cfd->interface = fc;
+	cfd->taken=1;
+
+	return cfd_handle(cfd);
 }
 
 
-//Check for room for file_size bytes in cache
-//if no room, check for old files in cache that are not currently in use and if you find those, pop them out and return 1 saying there is now room
-// Else 0 if there's no room and you cannot make room
-static int try_make_room(int file_size)
+// Called with the shard locked. Takes a reference to the page holding the current contents
+// of the file and returns it, or returns NULL if there is none. A page that is out of date
+// is left for the miss to take out of the index.
+static struct cache_page* find_in_cache(struct cache_shard* shard, struct path_info* info)
 {
-	int bytes_used = 0;
-	link_list_foreach(cache.cache_page_list,count_bytes,&bytes_used); //stores bytes used into "bytes used"
+	struct cache_page* page = *index_slot(&shard->index,info->device,info->inode);
+	if(!page) return NULL; //the slot is empty
 
-	int bytes_free = cache.max_bytes_size-bytes_used;
-	if(file_size<=bytes_free) return 1;
+	if(page->file_size!=info->size || page->mtime.tv_sec!=info->mtime.tv_sec ||
+	   page->mtime.tv_nsec!=info->mtime.tv_nsec) return NULL;
 
-	int bytes_freeable = 0;
-	link_list_foreach(cache.cache_page_list,count_freeable,&bytes_freeable);
-	if((bytes_free+bytes_freeable)<file_size) return 0;
+	//Going from 0 needs the shard lock, which we have; closes take it for going to 0
+	__atomic_add_fetch(&page->ref_count,1,__ATOMIC_ACQUIRE);
+	page->entry.hits++;
+	return page;
+}
 
-	while(1)
-	{
+// Called with cache_mu and the shard locked. A page loaded before the file last changed is
+// taken out of the index so the file is loaded again; the page itself goes once the clients
+// still sending it are done.
+static void remove_stale(struct cache_shard* shard, struct path_info* info)
+{
+	struct cache_page* page = *index_slot(&shard->index,info->device,info->inode);
+	if(!page) return;
 
-		//find the time of any unused page
-		struct cache_page* cp = link_list_find(cache.cache_page_list,find_first_freeable,NULL);
-		time_t first_time = cp->last_use;
+	if(__atomic_load_n(&page->ref_count,__ATOMIC_ACQUIRE)==0) drop_page(page,0);
+	else index_remove(&shard->index,page);
+}
 
-		time_t oldest_time = first_time;
-		//find the time of the oldest unused page
-		link_list_foreach(cache.cache_page_list,calc_oldest_time,&oldest_time);
+//Check for room for file_size bytes in cache
+//if no room, evict the pages the policy picks among those not currently in use, and return 1 saying there is now room
+// Else 0 if there's no room and you cannot make room, or the admission filter turns the file down
+// Called with cache_mu locked
+static int try_make_room(int file_size, uint64_t key)
+{
+	int bytes_free = cache.max_bytes_size-cache.bytes_used;
+	if(file_size<=bytes_free) return 1;
 
-		//find the oldest unused page
-		cp = link_list_find(cache.cache_page_list,find_oldest_page,&oldest_time);
+	if((bytes_free+cache.bytes_freeable)<file_size) return 0;
 
-		//remove that page
-		link_list_remove(cache.cache_page_list,cp);
-		printf("File of size %d evicted\n",cp->file_size);
+	//TinyLFU: a file only pushes out a page if it is asked for more often
+	struct policy_entry* victim = cache.policy->victim_ptr(cache.policy);
+	if(cache.sketch && victim && sketch_estimate(cache.sketch,key) <= sketch_estimate(cache.sketch,victim->key)) return 0;
 
-		//Now is there enough room?
-		bytes_used = 0;
-		link_list_foreach(cache.cache_page_list,count_bytes,&bytes_used); //stores bytes used into "bytes used"
-		bytes_free = cache.max_bytes_size-bytes_used;
-		if(file_size<=bytes_free) break;
+	while(cache.max_bytes_size-cache.bytes_used<file_size)
+	{
+		victim = cache.policy->victim_ptr(cache.policy);
+		if(!victim) return 0;
+
+		//The victim may have been opened since it was released, holding only its shard lock
+		struct cache_page* page = page_of(victim);
+		struct cache_shard* shard = shard_of(page->device,page->inode);
+		pthread_mutex_lock(&shard->mu);
+		if(__atomic_load_n(&page->ref_count,__ATOMIC_ACQUIRE)>0) acquire_page(page);
+		else drop_page(page,1);
+		pthread_mutex_unlock(&shard->mu);
 	}
 	return 1;
 }
@@ -455,147 +802,196 @@ static int try_make_room(int file_size)
 /* Upper Level Functions */
 
 
-// Determine what type of file is being asked for! Return the cfd ID
+// Determine what type of file is being asked for! Return the cfd handle
 static int assign_file(struct cfd* cfd, char *file)
 {
-	//Check if file is already cached - if yes, link the cfd to the already-cached file
-	struct cache_page* fc = find_in_cache(file); //return a pointer to the file cached
-	if (fc)	return join(cfd,fc);
-
-	//If file is not in cache
-	FILE* f = fopen(file,"rb"); //r=read only mode, b is a specificity for windows systems
-	if(!f)
+	//Resolve the path, from memory if it was looked up since it last changed
+	struct path_info info;
+	pthread_mutex_lock(&cache.path_mu);
+	int found = path_cache_lookup(file,&info);
+	pthread_mutex_unlock(&cache.path_mu);
+	if(!found)
 	{
 		return -1;// MAKE SURE THIS IS HANDLED AS A 404 "File not found"
 	}
-	if(-1 == fseek(f,0,SEEK_END)) return -1;  //Returns 0 if successful, -1 if there was corruption
-	int file_size = ftell(f); //tells the current position which is = to the number of bytes since we're pointing to the end of the file from the line above (FILE* rememebers state)
-	//Use file_size to determine if it fits int the cache
 
-	fclose(f);
-	//is there room in the cache, and call the right function
-	int cache_has_room = try_make_room(file_size); //0 if cache is full & no room - hence need to open file outside of cache
-	if (!cache_has_room)
+	uint64_t key = page_hash(info.device,info.inode);
+	if(cache.sketch) sketch_add(cache.sketch,key);
+	__atomic_add_fetch(&cache.stats.requests,1,__ATOMIC_RELAXED);
+	__atomic_add_fetch(&cache.stats.bytes_requested,info.size,__ATOMIC_RELAXED);
+
+	//Check if file is already cached - if yes, link the cfd to the already-cached file.
+	//This is the common case, and only needs the shard.
+	struct cache_shard* shard = shard_of(info.device,info.inode);
+	pthread_mutex_lock(&shard->mu);
+	struct cache_page* fc = find_in_cache(shard,&info); //return a pointer to the file cached
+	pthread_mutex_unlock(&shard->mu);
+	int hit = fc != NULL;
+
+	if (!fc)
+	{
+		//A miss changes what is cached: look again holding cache_mu, another miss may have just loaded it
+		pthread_mutex_lock(&cache.cache_mu);
+		pthread_mutex_lock(&shard->mu);
+		fc = find_in_cache(shard,&info);
+		if(!fc) remove_stale(shard,&info);
+		pthread_mutex_unlock(&shard->mu);
+		hit = fc != NULL;
+
+		//If file is not in cache, use its size to determine if it fits in the cache
+		//is there room in the cache, and call the right function
+		int changed = 0;
+		if (!fc && try_make_room(info.size,key)) //0 if cache is full & no room - hence need to open file outside of cache
+		{
+			fc = add_to_cache(file,&info,&changed);
+		}
+		pthread_mutex_unlock(&cache.cache_mu);
+
+		//The file changed before its event was read: resolve it again next time, and send it from disk now
+		if (changed)
+		{
+			pthread_mutex_lock(&cache.path_mu);
+			path_cache_forget(file);
+			pthread_mutex_unlock(&cache.path_mu);
+		}
+	}
+	cfd->hit = hit;
+	if (!fc)
 	{
-		return open_not_cached(cfd,file,file_size);
+		return open_not_cached(cfd,file);
 	}
-	return open_cached(cfd,file,file_size);
+	if (hit)
+	{
+		__atomic_add_fetch(&cache.stats.hits,1,__ATOMIC_RELAXED);
+		__atomic_add_fetch(&cache.stats.bytes_hit,info.size,__ATOMIC_RELAXED);
+	}
+	return join(cfd,fc);
 }
 
 
 
 int cache_open(char *file)
 {
-	//Lock!
-	pthread_mutex_lock(&cache.cache_mu);
+	//Take a free cfd - without a lock, unless the table has to grow
+	struct cfd* cfd = alloc_cfd();
+	if(!cfd) return -1;
 
-	//determine if there's a free slot - if yes, fill it, if no expand the vector (realloc),
-
-	//Find CFD
-	int i = 0;
-	struct cfd* curr = cache.client_mgr.clients; //This will never be null
-	struct cfd* end = curr+cache.client_mgr.client_size; //will be one past the end
-	while (curr != end)
-	{
-		if (!(curr->taken))
-		{
-			curr->id = i; //set the ID of the new
-			int ret = assign_file(curr, file); //returns -1 if unsuccessful or ID number of successful assignment
-			pthread_mutex_unlock(&cache.cache_mu);
-			return ret;
-		}
-		curr++;
-		i++;
-	}
-	//Didn't find one - make the list bigger
-	//In real world, there would of course be a finite number of clients being handled, however for simplicity we'll let this list grow unbounded.
-	struct cfd* temp = realloc(cache.client_mgr.clients,(sizeof(struct cfd)*cache.client_mgr.client_size)*2); //allocate's memory for 1 client
-	if (temp == cache.client_mgr.clients)
-	{
-		pthread_mutex_unlock(&cache.cache_mu);
-		return -1;
-	}
-	cache.client_mgr.clients = temp;
-	cache.client_mgr.client_size*=2;
-	curr = cache.client_mgr.clients+cache.client_mgr.client_size/2;
-	memset(curr,0,(cache.client_mgr.client_size/2)*sizeof(struct cfd));
-	curr->id=i;
-	int ret = assign_file(curr,file); //insert at the first new slot (reminder to me: this works since arrays start at 0 so)
-	pthread_mutex_unlock(&cache.cache_mu);
+	int ret = assign_file(cfd,file); //returns -1 if unsuccessful or the handle of successful assignment
+	if(ret == -1) free_cfd(cfd);
 	return ret;
 }
 
 
+// None of the functions on an open cfd take a lock: the cfd belongs to the client until it
+// closes it, and the chunks it sits in never move
+
+
 int cache_send(int cfd, int client, int n)
 {
-	// Don't want global lock since we don't want to bottleneck
-	pthread_mutex_lock(&cache.cache_mu);
-	struct cfd* curr = cache.client_mgr.clients; //This will never be null
-	struct cfd* end = curr+cache.client_mgr.client_size; //will be one past the end
-	while(curr != end)
+	struct cfd* curr = find_cfd(cfd);
+	if(!curr) return -1; //didn't find that id
+	return curr->send_ptr(curr,client,n);
+}
+
+
+int cache_source(int cfd, const char **data, int *fd)
+{
+	struct cfd* curr = find_cfd(cfd);
+	if(!curr) return -1; //didn't find that id
+
+	if(curr->send_ptr==send_v_cached)
 	{
-		if(curr->id==cfd)
-		{
-			int ret = curr->send_ptr(curr,client,n);
-			pthread_mutex_unlock(&cache.cache_mu);
-			return ret;
-		}
-    curr++;
+		//The page can't be evicted while the cfd holds a reference to it
+		*data = curr->file.cached.cache_page->data;
+		*fd = -1;
 	}
-	pthread_mutex_unlock(&cache.cache_mu);
-	return -1; //didn't find that id
+	else
+	{
+		*data = NULL;
+		*fd = fileno(curr->file.not_cached.open_ptr);
+	}
+	return 0;
 }
 
 
 int cache_filesize(int cfd)
 {
-	pthread_mutex_lock(&cache.cache_mu);
-	//find the cfd
-	struct cfd* curr = cache.client_mgr.clients; //This will never be null
-	struct cfd* end = curr+cache.client_mgr.client_size; //will be one past the end
-	while(curr != end)
-	{
-		if(curr->id==cfd)
-		{
-			int ret = curr->filesize_ptr(curr);
-			pthread_mutex_unlock(&cache.cache_mu);
-			return ret;
-		}
-    curr++;
-	}
-	pthread_mutex_unlock(&cache.cache_mu);
-	return -1; //didn't find that id
+	struct cfd* curr = find_cfd(cfd);
+	if(!curr) return -1; //didn't find that id
+	return curr->filesize_ptr(curr);
+}
+
+
+int cache_hit(int cfd)
+{
+	struct cfd* curr = find_cfd(cfd);
+	if(!curr) return -1; //didn't find that id
+	return curr->hit;
 }
 
 
 int cache_close(int cfd)
 {
-	pthread_mutex_lock(&cache.cache_mu);
+	struct cfd* curr = find_cfd(cfd);
+	if(!curr) return -1;
+	return curr->close_ptr(curr);
+}
 
-	//find the cfd
-	struct cfd* curr = cache.client_mgr.clients; //This will never be null
-	struct cfd* end = curr+cache.client_mgr.client_size; //will be one past the end
-	while(curr != end)
-	{
-		if(curr->id==cfd)
-		{
-			int ret = curr->close_ptr(curr);
-			pthread_mutex_unlock(&cache.cache_mu);
-			return ret;
-		}
-    curr++;
-	}
-	pthread_mutex_unlock(&cache.cache_mu);
-	return -1;
+
+int cache_watch(const char *root)
+{
+	pthread_mutex_lock(&cache.path_mu);
+	int fd = path_cache_init(root);
+	pthread_mutex_unlock(&cache.path_mu);
+	return fd;
 }
 
 
-void cache_destroy()
+void cache_changes()
 {
-	link_list_destroy(cache.not_cached_list);
-	link_list_destroy(cache.cached_list);
-	link_list_destroy(cache.cache_page_list);
-	free(cache.client_mgr.clients);
+	pthread_mutex_lock(&cache.path_mu);
+	path_cache_events();
+	pthread_mutex_unlock(&cache.path_mu);
 }
 
 
+void cache_report(FILE *out)
+{
+	struct cache_stats st;
+	st.requests = __atomic_load_n(&cache.stats.requests,__ATOMIC_RELAXED);
+	st.hits = __atomic_load_n(&cache.stats.hits,__ATOMIC_RELAXED);
+	st.bytes_requested = __atomic_load_n(&cache.stats.bytes_requested,__ATOMIC_RELAXED);
+	st.bytes_hit = __atomic_load_n(&cache.stats.bytes_hit,__ATOMIC_RELAXED);
+	fprintf(out,"Cache policy %s%s: %ld of %ld opens hit (%.1f%%), %lld of %lld bytes hit (%.1f%%)\n",
+	        cache.policy->name,cache.sketch ? "+tinylfu" : "",
+	        st.hits,st.requests,st.requests ? 100.0*st.hits/st.requests : 0.0,
+	        st.bytes_hit,st.bytes_requested,st.bytes_requested ? 100.0*st.bytes_hit/st.bytes_requested : 0.0);
+	fprintf(out,"Cache pages: %ld loaded, %ld evicted, %ld dropped out of date\n",
+	        __atomic_load_n(&cache.stats.loads,__ATOMIC_RELAXED),
+	        __atomic_load_n(&cache.stats.evictions,__ATOMIC_RELAXED),
+	        __atomic_load_n(&cache.stats.stale_drops,__ATOMIC_RELAXED));
+	fprintf(out,"Cache descriptors: %d of %d in use, peak %d\n",
+	        __atomic_load_n(&cache.client_mgr.open,__ATOMIC_RELAXED),
+	        __atomic_load_n(&cache.client_mgr.num_chunks,__ATOMIC_RELAXED)*CFD_CHUNK,
+	        __atomic_load_n(&cache.client_mgr.peak,__ATOMIC_RELAXED));
+}
+
+
+void cache_destroy()
+{
+	struct ilist_link* pos;
+	struct ilist_link* tmp;
+	int i;
+	path_cache_destroy();
+	cache.policy->destroy_ptr(cache.policy);
+	sketch_destroy(cache.sketch);
+	ilist_foreach_safe(&cache.cache_page_list,pos,tmp)
+	{
+		ilist_remove(&cache.cache_page_list,pos);
+		free_page(ilist_item(pos,struct cache_page,link));
+	}
+	pool_destroy(cache.page_pool);
+	for(i = 0; i < CACHE_SHARDS; i++) free(cache.shards[i].index.slots);
+	for(i = 0; i < cache.client_mgr.num_chunks; i++) free(cache.client_mgr.chunks[i]);
+}
+
@@ -5,31 +5,80 @@
  *      Author: julie
  */
 
+#include <stdio.h>
+
 /*
- * Initializes; returns nothing
+ * Initializes a cache of size bytes. policy picks the pages to evict: lru,
+ * arc or gdsf, NULL for lru. Adding +tinylfu (or just tinylfu, for lru)
+ * only lets a file in if it is asked for more often than the page it would
+ * evict. Returns 0 if success, -1 if there is no such policy
  */
-void cache_init(int size);
+int cache_init(int size, const char *policy);
 
 /*
- * Returns -1 if error, else returns the ID number of the CFD
+ * If enable is 1, files cached from now on are mapped read-only with mmap
+ * instead of being copied into memory. Files must not be truncated while
+ * they are cached this way.
+ */
+void cache_use_mmap(int enable);
+
+/*
+ * Returns -1 if error, else returns a handle to the CFD. Once the CFD is
+ * closed the handle is refused by every call, even after its slot is reused
  */
 int cache_open(char *file);
 
 /*
- * Returns the number of bytes sent or -1 if fail
+ * Returns the number of bytes sent or -1 if fail. Like cache_source and
+ * cache_filesize it takes no lock: any thread may use an open cfd, as long
+ * as only one does at a time
  */
 int cache_send(int cfd, int client, int n);
 
+/*
+ * For callers that send the file themselves, such as with io_uring.
+ * Sets data to the cached contents of the file, or if it is not cached,
+ * data to NULL and fd to the open file. Both stay valid until cache_close.
+ * Returns 0 if success, -1 if fail
+ */
+int cache_source(int cfd, const char **data, int *fd);
+
 /*
  * Returns the size of the file or -1 if fail
  */
 int cache_filesize(int cfd);
 
+/*
+ * Returns 1 if the file was already cached when it was opened, 0 if it had
+ * to be loaded or is not cached, or -1 if fail
+ */
+int cache_hit(int cfd);
+
 /*
  * Return 0 if success, -1 if fail
  */
 int cache_close(int cfd);
 
+/*
+ * Watches the files under root, the working directory, so that cache_open
+ * can find them (or find them missing) without asking the file system.
+ * Returns a descriptor that becomes readable when files change, or -1 if
+ * fail, in which case every cache_open looks the file up
+ */
+int cache_watch(const char *root);
+
+/*
+ * Forgets the files that changed; call when the cache_watch descriptor is
+ * readable, before serving more requests
+ */
+void cache_changes();
+
+/*
+ * Prints how many opens and bytes were served from the cache, and how many
+ * pages were loaded, evicted or dropped for being out of date
+ */
+void cache_report(FILE *out);
+
 /*
  * For test purposes only
  */
@@ -0,0 +1,501 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cache_policy.h"
+
+#define ARC_T1 0           // resident, opened once since it was loaded
+#define ARC_T2 1           // resident, opened again
+#define ARC_B1 0           // ghost of a page evicted from T1
+#define ARC_B2 1           // ghost of a page evicted from T2
+#define ARC_GHOSTS_MIN 256 // starting number of ghost buckets, always a power of 2
+#define ARC_GHOSTS_MAX 65536 // ghosts kept at most, however small the files
+
+#define SKETCH_ROWS 4      // independent hashes of each key
+#define SKETCH_MAX 15      // counters saturate, like the 4-bit counters of the TinyLFU paper
+#define SKETCH_SAMPLE 10   // halve the counts after this many additions per counter
+
+
+/* LISTS */
+
+
+// Linked through policy_entry, the first is the least recently used
+struct policy_list {
+	struct ilist entries;
+	int bytes;                  // size summed over the entries
+};
+
+static void list_init(struct policy_list* list)
+{
+	ilist_init(&list->entries);
+	list->bytes=0;
+}
+
+static void list_append(struct policy_list* list, struct policy_entry* e)
+{
+	ilist_add_back(&list->entries,&e->link);
+	list->bytes+=e->size;
+	e->linked=1;
+}
+
+static void list_unlink(struct policy_list* list, struct policy_entry* e)
+{
+	ilist_remove(&list->entries,&e->link);
+	list->bytes-=e->size;
+	e->linked=0;
+}
+
+// Returns the first entry, or NULL if the list is empty
+static struct policy_entry* list_head(struct policy_list* list)
+{
+	struct ilist_link* first = ilist_first(&list->entries);
+	return first ? ilist_item(first,struct policy_entry,link) : NULL;
+}
+
+static void ignore_v(struct cache_policy* p, struct policy_entry* e)
+{
+}
+
+static void destroy_v(struct cache_policy* p)
+{
+	free(p->state);
+	free(p);
+}
+
+
+/* LRU: evict the page released longest ago */
+
+
+static void acquire_v_lru(struct cache_policy* p, struct policy_entry* e)
+{
+	list_unlink(p->state,e);
+}
+
+static void release_v_lru(struct cache_policy* p, struct policy_entry* e)
+{
+	list_append(p->state,e);
+}
+
+static struct policy_entry* victim_v_lru(struct cache_policy* p)
+{
+	return list_head(p->state);
+}
+
+static void remove_v_lru(struct cache_policy* p, struct policy_entry* e, int evicted)
+{
+	if(e->linked) list_unlink(p->state,e);
+}
+
+
+/* ARC: split the cache between pages opened once (T1) and pages opened again (T2), moving
+ * the split towards whichever side recently evicted pages that were then asked for again.
+ * Everything is counted in bytes rather than pages, as files differ in size. */
+
+
+// Remembers an evicted page (just its key and size)
+struct ghost {
+	struct policy_entry entry;  // in B1 or B2
+	struct ghost* chain;        // next in the same bucket
+};
+
+struct arc {
+	struct policy_list t[2];    // released pages of T1 and T2
+	int resident[2];            // bytes of T1 and T2, released or not
+	struct policy_list b[2];    // ghosts of B1 and B2
+	struct ghost** buckets;     // the ghosts by key
+	int capacity;
+	int count;
+	int target;                 // bytes of T1 aimed for
+	int max_bytes;
+};
+
+// Returns the link pointing at the ghost for key, or at the NULL ending its bucket
+static struct ghost** ghost_slot(struct arc* a, uint64_t key)
+{
+	struct ghost** link = &a->buckets[(key ^ (key >> 32)) & (a->capacity-1)];
+	while(*link && (*link)->entry.key != key) link = &(*link)->chain;
+	return link;
+}
+
+static void ghost_drop(struct arc* a, struct ghost** link)
+{
+	struct ghost* g = *link;
+	*link = g->chain;
+	list_unlink(&a->b[g->entry.list],&g->entry);
+	a->count--;
+	free(g);
+}
+
+static void ghost_drop_oldest(struct arc* a, int list)
+{
+	struct ghost* g = (struct ghost*) list_head(&a->b[list]); //entry is the first member
+	ghost_drop(a,ghost_slot(a,g->entry.key));
+}
+
+// Keeps T1+B1 within the cache size, and all four lists within twice that
+static void trim_ghosts(struct arc* a)
+{
+	while(list_head(&a->b[ARC_B1]) && (a->resident[ARC_T1]+a->b[ARC_B1].bytes > a->max_bytes || a->count > ARC_GHOSTS_MAX))
+	{
+		ghost_drop_oldest(a,ARC_B1);
+	}
+	while(list_head(&a->b[ARC_B2]) && ((long long)a->resident[ARC_T1]+a->resident[ARC_T2]+a->b[ARC_B1].bytes+a->b[ARC_B2].bytes >
+	                            2LL*a->max_bytes || a->count > ARC_GHOSTS_MAX))
+	{
+		ghost_drop_oldest(a,ARC_B2);
+	}
+}
+
+static void ghost_add(struct arc* a, int list, struct policy_entry* e)
+{
+	if(a->count >= a->capacity)
+	{
+		struct ghost** buckets = calloc(a->capacity*2,sizeof(struct ghost*));
+		if(buckets)
+		{
+			for(int i = 0; i < a->capacity; i++)
+			{
+				while(a->buckets[i])
+				{
+					struct ghost* g = a->buckets[i];
+					a->buckets[i] = g->chain;
+					uint64_t key = g->entry.key;
+					g->chain = buckets[(key ^ (key >> 32)) & (a->capacity*2-1)];
+					buckets[(key ^ (key >> 32)) & (a->capacity*2-1)] = g;
+				}
+			}
+			free(a->buckets);
+			a->buckets = buckets;
+			a->capacity *= 2;
+		}
+	}
+
+	struct ghost** link = ghost_slot(a,e->key);
+	if(*link) ghost_drop(a,link);
+	struct ghost* g = calloc(1,sizeof(struct ghost));
+	if(!g) return; //it is only a hint
+	g->entry.key = e->key;
+	g->entry.size = e->size;
+	g->entry.list = list;
+	list_append(&a->b[list],&g->entry);
+	g->chain = *link;
+	*link = g;
+	a->count++;
+	trim_ghosts(a);
+}
+
+static void insert_v_arc(struct cache_policy* p, struct policy_entry* e)
+{
+	struct arc* a = p->state;
+	struct ghost** link = ghost_slot(a,e->key);
+
+	e->list = ARC_T1;
+	if(*link)
+	{
+		//Evicted too soon: give the side it was evicted from more room, and this time it counts as a repeat
+		int from = (*link)->entry.list;
+		int other = a->b[!from].bytes;
+		long long delta = (long long)e->size * (other > a->b[from].bytes && a->b[from].bytes ? other/a->b[from].bytes : 1);
+		if(from == ARC_B1) a->target = a->target+delta > a->max_bytes ? a->max_bytes : a->target+delta;
+		else a->target = a->target-delta < 0 ? 0 : a->target-delta;
+		e->list = ARC_T2;
+		ghost_drop(a,link);
+	}
+	a->resident[e->list] += e->size;
+	trim_ghosts(a);
+}
+
+static void hit_v_arc(struct cache_policy* p, struct policy_entry* e)
+{
+	struct arc* a = p->state;
+	if(e->list == ARC_T1) //opened again
+	{
+		a->resident[ARC_T1] -= e->size;
+		a->resident[ARC_T2] += e->size;
+		e->list = ARC_T2;
+	}
+}
+
+static void acquire_v_arc(struct cache_policy* p, struct policy_entry* e)
+{
+	struct arc* a = p->state;
+	list_unlink(&a->t[e->list],e);
+}
+
+static void release_v_arc(struct cache_policy* p, struct policy_entry* e)
+{
+	struct arc* a = p->state;
+	list_append(&a->t[e->list],e);
+}
+
+static struct policy_entry* victim_v_arc(struct cache_policy* p)
+{
+	struct arc* a = p->state;
+	if(list_head(&a->t[ARC_T1]) && (a->resident[ARC_T1] > a->target || !list_head(&a->t[ARC_T2])))
+	{
+		return list_head(&a->t[ARC_T1]);
+	}
+	return list_head(&a->t[ARC_T2]);
+}
+
+static void remove_v_arc(struct cache_policy* p, struct policy_entry* e, int evicted)
+{
+	struct arc* a = p->state;
+	if(e->linked) list_unlink(&a->t[e->list],e);
+	a->resident[e->list] -= e->size;
+	if(evicted) ghost_add(a,e->list == ARC_T1 ? ARC_B1 : ARC_B2,e);
+}
+
+static void destroy_v_arc(struct cache_policy* p)
+{
+	struct arc* a = p->state;
+	while(list_head(&a->b[ARC_B1])) ghost_drop_oldest(a,ARC_B1);
+	while(list_head(&a->b[ARC_B2])) ghost_drop_oldest(a,ARC_B2);
+	free(a->buckets);
+	destroy_v(p);
+}
+
+
+/* GDSF: Greedy-Dual-Size-Frequency. A page is worth its opens per byte, plus the worth of
+ * the last page evicted, so that pages which were valuable long ago don't stay forever.
+ * Many small popular files are kept ahead of one large one. */
+
+
+struct gdsf {
+	struct policy_entry** heap; // released pages, the lowest priority first
+	int count;
+	int capacity;
+	double inflation;           // priority of the last page evicted
+};
+
+static void heap_set(struct gdsf* g, int i, struct policy_entry* e)
+{
+	g->heap[i] = e;
+	e->list = i;
+}
+
+static void sift_up(struct gdsf* g, int i)
+{
+	struct policy_entry* e = g->heap[i];
+	while(i > 0 && g->heap[(i-1)/2]->priority > e->priority)
+	{
+		heap_set(g,i,g->heap[(i-1)/2]);
+		i = (i-1)/2;
+	}
+	heap_set(g,i,e);
+}
+
+static void sift_down(struct gdsf* g, int i)
+{
+	struct policy_entry* e = g->heap[i];
+	while(2*i+1 < g->count)
+	{
+		int child = 2*i+1;
+		if(child+1 < g->count && g->heap[child+1]->priority < g->heap[child]->priority) child++;
+		if(g->heap[child]->priority >= e->priority) break;
+		heap_set(g,i,g->heap[child]);
+		i = child;
+	}
+	heap_set(g,i,e);
+}
+
+static void heap_remove(struct gdsf* g, struct policy_entry* e)
+{
+	int i = e->list;
+	struct policy_entry* last = g->heap[--g->count];
+	e->linked = 0;
+	if(last == e) return;
+	heap_set(g,i,last);
+	sift_up(g,i);
+	sift_down(g,last->list);
+}
+
+static void acquire_v_gdsf(struct cache_policy* p, struct policy_entry* e)
+{
+	heap_remove(p->state,e);
+}
+
+static void release_v_gdsf(struct cache_policy* p, struct policy_entry* e)
+{
+	struct gdsf* g = p->state;
+	if(g->count == g->capacity)
+	{
+		int capacity = g->capacity ? g->capacity*2 : 64;
+		struct policy_entry** heap = realloc(g->heap,capacity*sizeof(struct policy_entry*));
+		if(!heap) return; //not evictable then, until it is released again
+		g->heap = heap;
+		g->capacity = capacity;
+	}
+	e->priority = g->inflation + (double)e->hits / (e->size ? e->size : 1);
+	e->linked = 1;
+	heap_set(g,g->count++,e);
+	sift_up(g,e->list);
+}
+
+static struct policy_entry* victim_v_gdsf(struct cache_policy* p)
+{
+	struct gdsf* g = p->state;
+	return g->count ? g->heap[0] : NULL;
+}
+
+static void remove_v_gdsf(struct cache_policy* p, struct policy_entry* e, int evicted)
+{
+	struct gdsf* g = p->state;
+	if(e->linked) heap_remove(g,e);
+	if(evicted) g->inflation = e->priority;
+}
+
+static void destroy_v_gdsf(struct cache_policy* p)
+{
+	struct gdsf* g = p->state;
+	free(g->heap);
+	destroy_v(p);
+}
+
+
+/* Upper Level Functions */
+
+
+struct cache_policy* policy_create(const char* name, int max_bytes)
+{
+	struct cache_policy* p = calloc(1,sizeof(struct cache_policy));
+	if(!p) return NULL;
+
+	p->insert_ptr=ignore_v;
+	p->hit_ptr=ignore_v;
+	p->destroy_ptr=destroy_v;
+	if(strcmp(name,"lru") == 0)
+	{
+		p->name="lru";
+		p->state=calloc(1,sizeof(struct policy_list));
+		if(p->state) list_init(p->state);
+		p->acquire_ptr=acquire_v_lru;
+		p->release_ptr=release_v_lru;
+		p->victim_ptr=victim_v_lru;
+		p->remove_ptr=remove_v_lru;
+	}
+	else if(strcmp(name,"arc") == 0)
+	{
+		p->name="arc";
+		struct arc* a = calloc(1,sizeof(struct arc));
+		p->state=a;
+		if(a)
+		{
+			a->max_bytes=max_bytes;
+			for(int i = 0; i < 2; i++)
+			{
+				list_init(&a->t[i]);
+				list_init(&a->b[i]);
+			}
+			a->capacity=ARC_GHOSTS_MIN;
+			a->buckets=calloc(ARC_GHOSTS_MIN,sizeof(struct ghost*));
+			if(!a->buckets)
+			{
+				free(a);
+				p->state=NULL;
+			}
+		}
+		p->insert_ptr=insert_v_arc;
+		p->hit_ptr=hit_v_arc;
+		p->acquire_ptr=acquire_v_arc;
+		p->release_ptr=release_v_arc;
+		p->victim_ptr=victim_v_arc;
+		p->remove_ptr=remove_v_arc;
+		p->destroy_ptr=destroy_v_arc;
+	}
+	else if(strcmp(name,"gdsf") == 0)
+	{
+		p->name="gdsf";
+		p->state=calloc(1,sizeof(struct gdsf));
+		p->acquire_ptr=acquire_v_gdsf;
+		p->release_ptr=release_v_gdsf;
+		p->victim_ptr=victim_v_gdsf;
+		p->remove_ptr=remove_v_gdsf;
+		p->destroy_ptr=destroy_v_gdsf;
+	}
+	if(!p->state)
+	{
+		free(p);
+		return NULL;
+	}
+	return p;
+}
+
+
+/* TinyLFU */
+
+
+struct frequency_sketch {
+	unsigned char* counters;    // SKETCH_ROWS rows of width counters
+	unsigned int mask;          // width-1, the width is a power of 2
+	int additions;              // since the counts were last halved
+	int sample;
+};
+
+static unsigned int sketch_index(const struct frequency_sketch* s, uint64_t key, int row)
+{
+	static const uint64_t seeds[SKETCH_ROWS] = {
+		0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL };
+	uint64_t h = (key+row) * seeds[row];
+	h ^= h >> 29;
+	return row*(s->mask+1) + (unsigned int)(h & s->mask);
+}
+
+struct frequency_sketch* sketch_create(int entries)
+{
+	struct frequency_sketch* s = calloc(1,sizeof(struct frequency_sketch));
+	if(!s) return NULL;
+
+	unsigned int width = 1024;
+	while(width < (unsigned int)entries && width < (1u << 24)) width *= 2;
+	s->counters = calloc(SKETCH_ROWS,width);
+	if(!s->counters)
+	{
+		free(s);
+		return NULL;
+	}
+	s->mask = width-1;
+	s->sample = SKETCH_SAMPLE*width;
+	return s;
+}
+
+int sketch_estimate(const struct frequency_sketch* s, uint64_t key)
+{
+	int min = SKETCH_MAX;
+	for(int row = 0; row < SKETCH_ROWS; row++)
+	{
+		int count = __atomic_load_n(&s->counters[sketch_index(s,key,row)],__ATOMIC_RELAXED);
+		if(count < min) min = count;
+	}
+	return min;
+}
+
+void sketch_add(struct frequency_sketch* s, uint64_t key)
+{
+	//Only the smallest counters go up, which keeps the others from overestimating as much.
+	//Threads adding at once may lose a count now and then, which a sketch can live with.
+	int min = sketch_estimate(s,key);
+	if(min < SKETCH_MAX)
+	{
+		for(int row = 0; row < SKETCH_ROWS; row++)
+		{
+			unsigned char* count = &s->counters[sketch_index(s,key,row)];
+			if(__atomic_load_n(count,__ATOMIC_RELAXED) == min) __atomic_store_n(count,min+1,__ATOMIC_RELAXED);
+		}
+	}
+
+	//Exactly one thread reaches the sample, and it halves the counts
+	if(__atomic_add_fetch(&s->additions,1,__ATOMIC_RELAXED) == s->sample)
+	{
+		for(unsigned int i = 0; i < SKETCH_ROWS*(s->mask+1); i++)
+		{
+			__atomic_store_n(&s->counters[i],__atomic_load_n(&s->counters[i],__ATOMIC_RELAXED) >> 1,__ATOMIC_RELAXED);
+		}
+		__atomic_sub_fetch(&s->additions,s->sample/2,__ATOMIC_RELAXED);
+	}
+}
+
+void sketch_destroy(struct frequency_sketch* s)
+{
+	if(!s) return;
+	free(s->counters);
+	free(s);
+}
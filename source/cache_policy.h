@@ -0,0 +1,60 @@
+#ifndef CACHE_POLICY_H_
+#define CACHE_POLICY_H_
+
+#include <stdint.h>
+#include "list.h"
+
+/* The replacement policies of cache.c, and the TinyLFU admission filter.
+ * Every cache page has a policy_entry in it, which is all a policy sees.
+ * Pages that clients have open can't be evicted, so the policy is told
+ * when a page is released (its last client closed it) and acquired again,
+ * and only picks victims among the released pages.  Not thread safe;
+ * cache.c calls it while holding its lock.  The sketch is the exception:
+ * it may be used from several threads at once. */
+
+struct policy_entry {
+	struct ilist_link link;     // in one of the policy's lists, while released
+	uint64_t key;               // identifies the file, for ghost lists and frequencies
+	int size;
+	int list;                   // which list the policy files the entry under (GDSF: its place in the heap)
+	int linked;                 // 1 while the entry is in that list (or heap)
+	unsigned int hits;          // times the page was opened since it was loaded, kept by cache.c
+	double priority;            // GDSF: the lowest is evicted first
+};
+
+struct cache_policy {
+	const char* name;
+	void* state;
+
+	// A page was loaded for a miss; it starts out acquired
+	void (*insert_ptr)(struct cache_policy*, struct policy_entry*);
+	// The page was opened again since it was loaded; told just before it is released,
+	// as cache.c opens cached pages without taking the lock the policy is called under
+	void (*hit_ptr)(struct cache_policy*, struct policy_entry*);
+	// The first client opened the released page: it can't be evicted any more
+	void (*acquire_ptr)(struct cache_policy*, struct policy_entry*);
+	// The last client closed the page: it can be evicted
+	void (*release_ptr)(struct cache_policy*, struct policy_entry*);
+	// Returns the released entry to evict next, or NULL if there is none
+	struct policy_entry* (*victim_ptr)(struct cache_policy*);
+	// The page leaves the cache: evicted is 1 if it was the victim, 0 if it went out of date
+	void (*remove_ptr)(struct cache_policy*, struct policy_entry*, int evicted);
+	void (*destroy_ptr)(struct cache_policy*);
+};
+
+/* Returns the policy called name ("lru", "arc" or "gdsf") for a cache of
+ * max_bytes, or NULL if there is no such policy or out of memory. */
+struct cache_policy* policy_create( const char* name, int max_bytes );
+
+/* TinyLFU: a count-min sketch of how often each key was asked for.  The
+ * counts are halved every few times the sketch fills up, so that old
+ * popularity fades. */
+struct frequency_sketch;
+
+/* Sized for about entries different keys.  Returns NULL if out of memory. */
+struct frequency_sketch* sketch_create( int entries );
+void sketch_add( struct frequency_sketch*, uint64_t key );
+int sketch_estimate( const struct frequency_sketch*, uint64_t key );
+void sketch_destroy( struct frequency_sketch* );
+
+#endif /* CACHE_POLICY_H_ */
@@ -1,18 +1,20 @@
 #include "cache.h"
 #include <assert.h>
 #include <stdio.h>
+#include <unistd.h>
 
 int main()
 {
 
   const int size = 20;
-  cache_init( size );
+  assert( 0 == cache_init( size, NULL ));
   {
     int bad = cache_open( "there is no way this file exists" );
     assert( bad == -1 );
   }
   int cfd_id = cache_open( "testfile" );
   assert( -1 != cfd_id );
+  assert( 0 == cache_hit( cfd_id ));  /* loaded, not a hit */
 
   FILE* out = fopen( "output", "wb" );
   assert( out );
@@ -34,6 +36,8 @@ int main()
   /* Should have a cache-hit for this */
   int cfd_id3 = cache_open( "testfile" );
   assert( -1 != cfd_id3 );
+  assert( 1 == cache_hit( cfd_id3 ));
+  assert( 0 == cache_hit( cfd_id2 ));
 
   assert( -1 != cache_close( cfd_id ));
   assert( -1 != cache_close( cfd_id2 ));
@@ -46,8 +50,99 @@ int main()
 
   /* Re-open testfile and it will now end up in the non-cached list */
   cfd_id2 = cache_open( "testfile" );
+  assert( -1 != cfd_id2 );
+  assert( -1 != cache_close( cfd_id2 ));
+
+  cache_destroy();
+
+  /* The same with pages mapped from the files */
+  cache_use_mmap( 1 );
+  assert( 0 == cache_init( size, NULL ));
+  cfd_id = cache_open( "testfile" );
+  assert( -1 != cfd_id );
+  assert( 11 == cache_send( cfd_id, fileno( out ), 11 ));
+  assert( 0 == cache_send( cfd_id, fileno( out ), 10 ));
+
+  /* A cache hit shares the mapping */
+  cfd_id2 = cache_open( "testfile" );
+  assert( -1 != cfd_id2 );
+  assert( 11 == cache_send( cfd_id2, fileno( out ), 11 ));
+  assert( -1 != cache_close( cfd_id ));
+  assert( -1 != cache_close( cfd_id2 ));
+
+  /* Evicting the unused mapping makes room for testfile2 */
+  cfd_id = cache_open( "testfile2" );
   assert( -1 != cfd_id );
+  assert( 11 == cache_send( cfd_id, fileno( out ), 11 ));
+  assert( -1 != cache_close( cfd_id ));
+
+  cache_destroy();
+  cache_use_mmap( 0 );
+
+  /* Every policy evicts the page nobody has open */
+  const char* policies[] = { "lru", "arc", "gdsf", "arc+tinylfu" };
+  const char* data;
+  int fd;
+  for( int i = 0; i < 4; ++i ) {
+    assert( 0 == cache_init( size, policies[i] ));
+    cfd_id = cache_open( "testfile" );
+    assert( -1 != cache_close( cfd_id ));
+    cfd_id = cache_open( "testfile2" );
+    if( i < 3 ) {
+      assert( 0 == cache_source( cfd_id, &data, &fd ) && data );
+    }
+    assert( 11 == cache_send( cfd_id, fileno( out ), 11 ));
+    assert( -1 != cache_close( cfd_id ));
+    cache_destroy();
+  }
+  assert( -1 == cache_init( size, "fifo" ));
+
+  /* TinyLFU keeps the file asked for more often */
+  assert( 0 == cache_init( size, "tinylfu" ));
+  for( int i = 0; i < 3; ++i ) {
+    cfd_id = cache_open( "testfile" );
+    assert( -1 != cache_close( cfd_id ));
+  }
+  cfd_id = cache_open( "testfile2" );
+  assert( 0 == cache_source( cfd_id, &data, &fd ) && !data );  /* from disk */
+  assert( 11 == cache_send( cfd_id, fileno( out ), 11 ));
+  assert( -1 != cache_close( cfd_id ));
+  cfd_id = cache_open( "testfile" );
+  assert( 0 == cache_source( cfd_id, &data, &fd ) && data );
+  assert( -1 != cache_close( cfd_id ));
+  cache_report( stdout );
+
+  /* A closed handle stays closed, even once its cfd is reused */
+  cfd_id = cache_open( "testfile" );
+  assert( -1 != cache_close( cfd_id ));
+  assert( -1 == cache_close( cfd_id ));
+  cfd_id2 = cache_open( "testfile" );
+  assert( -1 != cfd_id2 && cfd_id2 != cfd_id );
+  assert( -1 == cache_filesize( cfd_id ));
+  assert( -1 == cache_send( cfd_id, fileno( out ), 1 ));
+  assert( -1 == cache_hit( cfd_id ));
+  assert( 11 == cache_filesize( cfd_id2 ));
+  assert( -1 != cache_close( cfd_id2 ));
+
+  cache_destroy();
+
+  /* A file that changed before its event was read is sent as it is now */
+  assert( 0 == cache_init( size, NULL ) && cache_watch( "." ) >= 0 );
+  FILE* f = fopen( "testfile3", "w" );
+  assert( f && fputs( "helloworld", f ) >= 0 && 0 == fclose( f ));
+  cfd_id2 = cache_open( "testfile" );                /* no room for testfile3 */
+  cfd_id = cache_open( "testfile3" );
+  assert( 10 == cache_filesize( cfd_id ) && -1 != cache_close( cfd_id ));
+  assert( -1 != cache_close( cfd_id2 ));
+  f = fopen( "testfile3", "w" );
+  assert( f && fputs( "hey", f ) >= 0 && 0 == fclose( f ));
+  cfd_id = cache_open( "testfile3" );
+  assert( 3 == cache_filesize( cfd_id ) && 0 == cache_hit( cfd_id ));
+  assert( 3 == cache_send( cfd_id, fileno( out ), 10 ));
   assert( -1 != cache_close( cfd_id ));
+  cfd_id = cache_open( "testfile3" );
+  assert( 3 == cache_filesize( cfd_id ) && -1 != cache_close( cfd_id ));
+  unlink( "testfile3" );
 
   fclose( out );
 
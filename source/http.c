@@ -0,0 +1,184 @@
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "http.h"
+
+/* Parser states */
+#define PARSE_METHOD		0	/* in the method, e.g. GET */
+#define PARSE_PATH		1	/* in the requested path */
+#define PARSE_VERSION		2	/* in the version, e.g. HTTP/1.1 */
+#define PARSE_LINE_LF		3	/* saw CR at the end of the request line */
+#define PARSE_HEADER_START	4	/* at the start of a header line */
+#define PARSE_HEADER_NAME	5	/* in a header name */
+#define PARSE_HEADER_SPACE	6	/* between the colon and the header value */
+#define PARSE_HEADER_VALUE	7	/* in a header value */
+#define PARSE_HEADER_LF		8	/* saw CR at the end of a header line */
+#define PARSE_END_LF		9	/* saw CR on the blank line ending the headers */
+#define PARSE_DONE		10	/* the request is complete */
+#define PARSE_ERROR		11	/* the request is malformed */
+
+extern void httpInit(struct HttpParser *parser){
+	memset(parser, 0, sizeof(struct HttpParser));
+	parser->state = PARSE_METHOD;
+}
+
+/* This function records the end of the current header value, dropping any
+ * trailing spaces, and moves on to the next header.
+ */
+static void endHeader(struct HttpParser *parser, const char *buffer, int end){
+	struct HttpHeader *header;
+
+	if (parser->numHeaders >= HTTP_MAX_HEADERS){	/* no room, skip it */
+		return;
+	}
+	while ((end > parser->mark) && ((buffer[end - 1] == ' ') || (buffer[end - 1] == '\t'))){
+		end--;
+	}
+	header = &parser->headers[parser->numHeaders++];
+	header->value.start = parser->mark;
+	header->value.length = end - parser->mark;
+}
+
+/* This function records the name of the header being parsed.
+ */
+static void startHeader(struct HttpParser *parser, int end){
+	if (parser->numHeaders < HTTP_MAX_HEADERS){
+		parser->headers[parser->numHeaders].name.start = parser->mark;
+		parser->headers[parser->numHeaders].name.length = end - parser->mark;
+	}
+}
+
+static void setToken(struct HttpToken *token, int start, int end){
+	token->start = start;
+	token->length = end - start;
+}
+
+extern int httpParse(struct HttpParser *parser, const char *buffer, int length){
+	int pos;
+	char c;
+
+	for (pos = parser->position; (pos < length) && (parser->state < PARSE_DONE); pos++){
+		c = buffer[pos];
+		switch (parser->state){
+		case PARSE_METHOD:
+			if ((c == ' ') && (pos > parser->mark)){
+				setToken(&parser->method, parser->mark, pos);
+				parser->mark = pos + 1;
+				parser->state = PARSE_PATH;
+			}
+			else if ((c < 'A') || (c > 'Z')){
+				parser->state = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_PATH:
+			if ((c == ' ') || (c == '\r') || (c == '\n')){
+				if (pos == parser->mark){
+					parser->state = PARSE_ERROR;
+					break;
+				}
+				setToken(&parser->path, parser->mark, pos);
+				parser->mark = pos + 1;
+				/* A request line without a version is an HTTP/0.9 request */
+				if (c == ' '){
+					parser->state = PARSE_VERSION;
+				}
+				else {
+					setToken(&parser->version, pos, pos);
+					parser->state = (c == '\r') ? PARSE_LINE_LF : PARSE_HEADER_START;
+				}
+			}
+			else if ((unsigned char)c < ' '){
+				parser->state = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_VERSION:
+			if ((c == '\r') || (c == '\n')){
+				setToken(&parser->version, parser->mark, pos);
+				parser->state = (c == '\r') ? PARSE_LINE_LF : PARSE_HEADER_START;
+			}
+			else if ((unsigned char)c <= ' '){
+				parser->state = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_LINE_LF:
+		case PARSE_HEADER_LF:
+			parser->state = (c == '\n') ? PARSE_HEADER_START : PARSE_ERROR;
+			break;
+
+		case PARSE_HEADER_START:
+			if (c == '\r'){
+				parser->state = PARSE_END_LF;
+			}
+			else if (c == '\n'){
+				parser->state = PARSE_DONE;
+			}
+			else if ((c == ' ') || (c == '\t') || (c == ':')){
+				parser->state = PARSE_ERROR;	/* folded lines are not supported */
+			}
+			else {
+				parser->mark = pos;
+				parser->state = PARSE_HEADER_NAME;
+			}
+			break;
+
+		case PARSE_HEADER_NAME:
+			if (c == ':'){
+				startHeader(parser, pos);
+				parser->state = PARSE_HEADER_SPACE;
+			}
+			else if ((unsigned char)c <= ' '){
+				parser->state = PARSE_ERROR;
+			}
+			break;
+
+		case PARSE_HEADER_SPACE:
+			if ((c == ' ') || (c == '\t')){
+				break;
+			}
+			parser->mark = pos;
+			parser->state = PARSE_HEADER_VALUE;
+			/* fall through, c is the first character of the value */
+
+		case PARSE_HEADER_VALUE:
+			if ((c == '\r') || (c == '\n')){
+				endHeader(parser, buffer, pos);
+				parser->state = (c == '\r') ? PARSE_HEADER_LF : PARSE_HEADER_START;
+			}
+			break;
+
+		case PARSE_END_LF:
+			parser->state = (c == '\n') ? PARSE_DONE : PARSE_ERROR;
+			break;
+		}
+	}
+	parser->position = pos;
+
+	if (parser->state == PARSE_DONE){
+		return HTTP_DONE;
+	}
+	else if (parser->state == PARSE_ERROR){
+		return HTTP_ERROR;
+	}
+	return HTTP_NEED_MORE;
+}
+
+extern int httpTokenIs(const char *buffer, struct HttpToken token, const char *text){
+	return ((int)strlen(text) == token.length) &&
+		(strncasecmp(buffer + token.start, text, token.length) == 0);
+}
+
+extern struct HttpHeader* httpFindHeader(struct HttpParser *parser, const char *buffer, const char *name){
+	int i;
+
+	for (i = 0; i < parser->numHeaders; i++){
+		if (httpTokenIs(buffer, parser->headers[i].name, name)){
+			return &parser->headers[i];
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,63 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+/* This is a resumable parser for HTTP requests. The request is parsed in
+ * place: the parser keeps no copy of the data, only the offsets of the
+ * request line parts and headers within the caller's buffer. The caller
+ * appends data to the buffer as it arrives and calls httpParse again, which
+ * picks up where it stopped. The buffer must not be moved or changed
+ * between calls.
+ */
+
+#define HTTP_MAX_HEADERS	32	/* headers kept per request, the rest are skipped */
+
+/* Return values of httpParse */
+#define HTTP_NEED_MORE		0	/* the request is not complete yet */
+#define HTTP_DONE		1	/* the request line and headers are complete */
+#define HTTP_ERROR		-1	/* the request is malformed */
+
+/* A part of the buffer, given as an offset and a length */
+struct HttpToken {
+	int start;
+	int length;
+};
+
+struct HttpHeader {
+	struct HttpToken name;
+	struct HttpToken value;
+};
+
+struct HttpParser {
+	int state;			/* where the parser stopped */
+	int position;			/* number of bytes parsed so far */
+	int mark;			/* start of the token being parsed */
+	struct HttpToken method;
+	struct HttpToken path;
+	struct HttpToken version;
+	struct HttpHeader headers[HTTP_MAX_HEADERS];
+	int numHeaders;
+};
+
+/* This function resets a parser so that it can parse a new request.
+ */
+extern void httpInit(struct HttpParser *parser);
+
+/* This function parses the bytes of buffer from where the last call stopped
+ * up to length. Both bare LF and CRLF line endings are accepted.
+ * It returns HTTP_NEED_MORE if the end of the headers has not been seen yet,
+ * HTTP_DONE once it has (parser->position is then the length of the request),
+ * or HTTP_ERROR if the request is malformed.
+ */
+extern int httpParse(struct HttpParser *parser, const char *buffer, int length);
+
+/* This function compares a token with a string, ignoring case.
+ * It returns 1 if they are the same, 0 if not.
+ */
+extern int httpTokenIs(const char *buffer, struct HttpToken token, const char *text);
+
+/* This function finds a header by name, ignoring case.
+ * It returns a pointer to the header, or NULL if the request does not have it.
+ */
+extern struct HttpHeader* httpFindHeader(struct HttpParser *parser, const char *buffer, const char *name);
+
+#endif
@@ -0,0 +1,65 @@
+
+#include "http.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Feeds the request to the parser one byte at a time, the way it would
+ * arrive over a very slow connection. */
+int parse_bytewise( struct HttpParser* p, const char* req ) {
+  int len = strlen( req );
+  int i;
+  int status = HTTP_NEED_MORE;
+
+  for( i = 1; i <= len; ++i ) {
+    status = httpParse( p, req, i );
+    if( i < len ) assert( status == HTTP_NEED_MORE );
+  }
+  return status;
+}
+
+int main() {
+
+  struct HttpParser p;
+  struct HttpHeader* h;
+  const char* req = "GET /foo/bar.html HTTP/1.1\r\nHost: localhost\r\n"
+                    "Connection:   keep-alive  \r\n\r\nGET /next";
+  const char* lf = "GET /sws.c HTTP/1.1\nHost: localhost\n\n";
+
+  /* Whole request in one go, with a pipelined request behind it */
+  httpInit( &p );
+  assert( HTTP_DONE == httpParse( &p, req, strlen( req )));
+  assert( p.position == (int)( strstr( req, "GET /next" ) - req ));
+  assert( httpTokenIs( req, p.method, "GET" ));
+  assert( httpTokenIs( req, p.path, "/foo/bar.html" ));
+  assert( httpTokenIs( req, p.version, "HTTP/1.1" ));
+  assert( 2 == p.numHeaders );
+  h = httpFindHeader( &p, req, "connection" );
+  assert( h && httpTokenIs( req, h->value, "keep-alive" ));
+  assert( NULL == httpFindHeader( &p, req, "Accept" ));
+
+  /* Same request split at every byte */
+  httpInit( &p );
+  assert( HTTP_DONE == parse_bytewise( &p, lf ));
+  assert( httpTokenIs( lf, p.path, "/sws.c" ));
+  h = httpFindHeader( &p, lf, "host" );
+  assert( h && httpTokenIs( lf, h->value, "localhost" ));
+
+  /* Malformed requests */
+  httpInit( &p );
+  assert( HTTP_ERROR == httpParse( &p, "get / HTTP/1.1\r\n\r\n", 18 ));
+  httpInit( &p );
+  assert( HTTP_ERROR == httpParse( &p, "GET  / HTTP/1.1\r\n\r\n", 19 ));
+  httpInit( &p );
+  assert( HTTP_ERROR == httpParse( &p, "GET / HTTP/1.1\rX\n\r\n", 19 ));
+  httpInit( &p );
+  assert( HTTP_ERROR == httpParse( &p, "GET / HTTP/1.1\r\nBad Header: x\r\n\r\n", 33 ));
+
+  /* Not complete yet */
+  httpInit( &p );
+  assert( HTTP_NEED_MORE == httpParse( &p, lf, strlen( lf ) - 1 ));
+  assert( HTTP_DONE == httpParse( &p, lf, strlen( lf )));
+
+  return EXIT_SUCCESS;
+
+}
@@ -0,0 +1,114 @@
+#include <time.h>
+#include "latency.h"
+#include "scheduler.h"
+
+#define SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+
+// The phases of a request that are timed, and the one from start to end
+enum { PHASE_READ, PHASE_PIPELINE, PHASE_QUEUE, PHASE_SEND, PHASE_TOTAL, PHASES };
+
+static const char* phase_names[PHASES] = { "read", "pipeline", "queue", "send", "total" };
+
+// One group of histograms per scheduler level, then cache hits and misses
+#define HITS MAX_LEVELS
+#define MISSES (MAX_LEVELS + 1)
+
+static struct latency_histogram histograms[MAX_LEVELS + 2][PHASES];
+
+
+/* BUCKETS */
+
+
+// Values below SUB_BUCKETS have a bucket each, then each power of two has SUB_BUCKETS
+static int bucket_of(long long ns)
+{
+	if(ns < SUB_BUCKETS) return ns > 0 ? (int)ns : 0;
+
+	int e = 63 - __builtin_clzll(ns);
+	if(e >= LATENCY_MAX_BITS) return LATENCY_BUCKETS - 1;
+	return ((e - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + (int)((ns >> (e - LATENCY_SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+// The highest value that falls in a bucket
+static long long bucket_top(int b)
+{
+	if(b < SUB_BUCKETS) return b;
+
+	int shift = (b >> LATENCY_SUB_BITS) - 1;
+	return (((long long)(SUB_BUCKETS + (b & (SUB_BUCKETS - 1))) + 1) << shift) - 1;
+}
+
+
+/* Upper Level Functions */
+
+
+long long latency_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return now.tv_sec*1000000000LL + now.tv_nsec;
+}
+
+void latency_record(struct latency_histogram* h, long long ns)
+{
+	h->buckets[bucket_of(ns)]++;
+	h->count++;
+	if(ns > h->max) h->max = ns;
+}
+
+long long latency_percentile(const struct latency_histogram* h, double percent)
+{
+	double exact = h->count*percent/100;
+	long target = (long)exact;
+	long seen = 0;
+
+	if(h->count == 0) return 0;
+	if(target < exact || target < 1) target++; //the value at the rank, rounded up
+	for(int b = 0; b < LATENCY_BUCKETS; b++)
+	{
+		seen += h->buckets[b];
+		if(seen < target) continue;
+		return (b < LATENCY_BUCKETS - 1 && bucket_top(b) < h->max) ? bucket_top(b) : h->max; //the last has no top
+	}
+	return h->max;
+}
+
+// Records a phase that was timed at both ends, for the level and the cache
+static void add_phase(const struct request_times* t, int phase, long long from, long long to)
+{
+	if(!from || !to) return;
+	latency_record(&histograms[t->level][phase],to - from);
+	latency_record(&histograms[t->cached ? HITS : MISSES][phase],to - from);
+}
+
+void latency_add(const struct request_times* t)
+{
+	add_phase(t,PHASE_READ,t->accepted,t->parsed);
+	add_phase(t,PHASE_PIPELINE,t->parsed,t->enqueued);
+	add_phase(t,PHASE_QUEUE,t->enqueued,t->started);
+	add_phase(t,PHASE_SEND,t->started,t->finished);
+	add_phase(t,PHASE_TOTAL,t->accepted ? t->accepted : t->parsed,t->finished);
+}
+
+void latency_report(FILE* out)
+{
+	char group[16];
+
+	fprintf(out,"Latency in microseconds       count        p50        p99       p999        max\n");
+	for(int g = 0; g < MAX_LEVELS + 2; g++)
+	{
+		if(histograms[g][PHASE_TOTAL].count == 0) continue;
+
+		if(g == HITS) snprintf(group,sizeof(group),"cache hit");
+		else if(g == MISSES) snprintf(group,sizeof(group),"cache miss");
+		else snprintf(group,sizeof(group),"level %d",g);
+		for(int p = 0; p < PHASES; p++)
+		{
+			const struct latency_histogram* h = &histograms[g][p];
+			if(h->count == 0) continue;
+			fprintf(out,"%-10s %-8s %12ld %10.1f %10.1f %10.1f %10.1f\n",group,phase_names[p],h->count,
+			        latency_percentile(h,50)/1000.0,latency_percentile(h,99)/1000.0,
+			        latency_percentile(h,99.9)/1000.0,h->max/1000.0);
+		}
+	}
+}
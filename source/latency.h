@@ -0,0 +1,50 @@
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdio.h>
+
+/* Latency histograms, log-bucketed like HDR histograms: each power of two
+ * is split into 1 << LATENCY_SUB_BITS buckets, so that a percentile is
+ * within 1/16 of the true value whatever its size.  Recording is one
+ * increment, and the whole range from 1 ns to LATENCY_MAX_BITS fits in a
+ * fixed array. */
+#define LATENCY_SUB_BITS 4
+#define LATENCY_MAX_BITS 40  // about 18 minutes, longer is counted as that
+#define LATENCY_BUCKETS  ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+struct latency_histogram {
+	long count;
+	long long max;
+	long buckets[LATENCY_BUCKETS];
+};
+
+/* When each phase of a request began, in nanoseconds of latency_now(),
+ * 0 if it was not timed. */
+struct request_times {
+	long long accepted;  // the connection, for its first request only
+	long long parsed;    // the whole request was read
+	long long enqueued;  // its job was handed to the scheduler
+	long long started;   // its first quantum began
+	long long finished;  // its last byte was sent
+	int level;           // scheduler level it finished at
+	int cached;          // 1 if the file was a cache hit when it was opened
+};
+
+/* Returns the time of a monotonic clock, in nanoseconds. */
+long long latency_now( void );
+
+void latency_record( struct latency_histogram*, long long ns );
+
+/* Returns the value below which percent of the values fall, to within a
+ * bucket, or 0 if the histogram is empty. */
+long long latency_percentile( const struct latency_histogram*, double percent );
+
+/* Adds the phases of a request that was sent to the histograms of its
+ * level and of cache hits or misses.  Only one thread may add requests. */
+void latency_add( const struct request_times* );
+
+/* Prints the percentiles of each phase, for the levels and the cache
+ * hits and misses that had requests. */
+void latency_report( FILE* out );
+
+#endif /* LATENCY_H_ */
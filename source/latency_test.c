@@ -0,0 +1,59 @@
+
+#include "latency.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+struct latency_histogram h;
+
+/* A percentile is at or above the true value, by at most 1/16 of it */
+void expect_near( double percent, long long value ) {
+  long long p = latency_percentile( &h, percent );
+  assert( p >= value && p <= value + value / 16 );
+}
+
+int main() {
+
+  struct request_times times = { 0 };
+  long long now, later;
+
+  assert( latency_percentile( &h, 50 ) == 0 );
+
+  /* Small values are exact */
+  for( int i = 1; i <= 10; ++i ) {
+    latency_record( &h, i );
+  }
+  assert( latency_percentile( &h, 50 ) == 5 && latency_percentile( &h, 100 ) == 10 );
+  assert( latency_percentile( &h, 0 ) == 1 && latency_percentile( &h, 99 ) == 10 );
+
+  /* 1 us to 1 s, one value for each microsecond */
+  h = ( struct latency_histogram ) { 0 };
+  for( long long us = 1; us <= 1000000; ++us ) {
+    latency_record( &h, us * 1000 );
+  }
+  expect_near( 50, 500000000 );
+  expect_near( 99, 990000000 );
+  expect_near( 99.9, 999000000 );
+  assert( latency_percentile( &h, 100 ) == 1000000000 && h.max == 1000000000 );
+
+  /* Values too big for the buckets still count, as the maximum */
+  latency_record( &h, 1LL << 50 );
+  assert( latency_percentile( &h, 100 ) == 1LL << 50 );
+
+  /* The clock goes forward, and requests are reported */
+  now = latency_now();
+  later = latency_now();
+  assert( now > 0 && later >= now );
+  times.parsed = now;
+  times.enqueued = now + 1000;
+  times.started = now + 5000;
+  times.finished = now + 105000;
+  times.level = 1;
+  latency_add( &times );
+  times.cached = 1;
+  latency_add( &times );
+  latency_report( stdout );
+
+  return EXIT_SUCCESS;
+
+}
@@ -1,6 +1,8 @@
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "list.h"
+#include "pool.h"
 
 struct node {
   struct node* next;
@@ -12,7 +14,17 @@ struct link_list {
   link_list_dtor dtor;
 };
 
+/* The nodes of every list come from one pool, made by the first list */
+static struct pool* node_pool;
+static pthread_once_t node_pool_once = PTHREAD_ONCE_INIT;
+
+static void make_node_pool( void ) {
+  node_pool = pool_create( "list nodes", sizeof( struct node ), 0 );
+}
+
 struct link_list* link_list_init( link_list_dtor dtor ) {
+  pthread_once( &node_pool_once, make_node_pool );
+  if( !node_pool ) return NULL;
   struct link_list* l = calloc( sizeof( struct link_list ), 1 );
   if( l ) l->dtor = dtor;
   return l;
@@ -26,7 +38,7 @@ void link_list_destroy( struct link_list* l )
     struct node* tmp = pos;
     pos = pos->next;
     if( l->dtor ) l->dtor( tmp->data );
-    free( tmp );
+    pool_free( node_pool, tmp );
   }
   free( l );
 }
@@ -59,7 +71,7 @@ void link_list_foreach( struct link_list* l,link_list_visit_predicate f, void* c
 
 int link_list_add_front( struct link_list* l, void* item )
 {
-  struct node* node = calloc( sizeof( struct node ), 1 );
+  struct node* node = pool_alloc( node_pool );
   if( !node ) return 0;
   node->next = l->head;
   node->data = item;
@@ -93,7 +105,63 @@ void link_list_remove( struct link_list* l, void* item )
   }
 
   if( l->dtor ) l->dtor( pos->data );
-  free( pos );
+  pool_free( node_pool, pos );
+
+}
+
+
+
+void ilist_init( struct ilist* l )
+{
+  l->head.prev = &l->head;
+  l->head.next = &l->head;
+  l->size = 0;
+}
+
+int ilist_empty( const struct ilist* l )
+{
+  return l->head.next == &l->head;
+}
 
+int ilist_linked( const struct ilist_link* link )
+{
+  return NULL != link->next;
 }
 
+/* Puts link between prev and next */
+static void ilist_insert( struct ilist* l, struct ilist_link* link, struct ilist_link* prev, struct ilist_link* next )
+{
+  link->prev = prev;
+  link->next = next;
+  prev->next = link;
+  next->prev = link;
+  l->size++;
+}
+
+void ilist_add_front( struct ilist* l, struct ilist_link* link )
+{
+  ilist_insert( l, link, &l->head, l->head.next );
+}
+
+void ilist_add_back( struct ilist* l, struct ilist_link* link )
+{
+  ilist_insert( l, link, l->head.prev, &l->head );
+}
+
+void ilist_remove( struct ilist* l, struct ilist_link* link )
+{
+  link->prev->next = link->next;
+  link->next->prev = link->prev;
+  link->prev = link->next = NULL;
+  l->size--;
+}
+
+struct ilist_link* ilist_first( const struct ilist* l )
+{
+  return ilist_empty( l ) ? NULL : l->head.next;
+}
+
+struct ilist_link* ilist_next( const struct ilist* l, const struct ilist_link* pos )
+{
+  return pos->next == &l->head ? NULL : pos->next;
+}
@@ -1,7 +1,9 @@
 #ifndef CACHE_LINK_LIST_H_
 #define CACHE_LINK_LIST_H_
 
-/* This is a singly linked list implementation as used by cache.c.  It only
+#include <stddef.h>
+
+/* This is a singly linked list implementation.  It only
  * supports push_front.  It does not take ownership of the void* items that
  * are passed it, that memory is up to the caller to manage. */
 struct link_list;
@@ -35,5 +37,49 @@ int link_list_add_front( struct link_list*, void* );
 /* Remove the item from the list.  no-op if it was not in the list. */
 void link_list_remove( struct link_list*, void* );
 
+/* This is an intrusive doubly linked list.  Instead of the list holding a
+ * pointer to each item, each item holds a struct ilist_link, so adding and
+ * removing allocate nothing and take O(1).  An item can be in as many lists
+ * at once as it has links.  The list owns none of its items. */
+struct ilist_link {
+  struct ilist_link* prev;
+  struct ilist_link* next;  /* both NULL while the link is in no list */
+};
+
+struct ilist {
+  struct ilist_link head;   /* the list is a ring through head */
+  int size;
+};
+
+/* The item holding link, given the type of the item and the name of its
+ * link member: ilist_item( pos, struct cache_page, link ) */
+#define ilist_item( link, type, member ) \
+  (( type* )(( char* )( link ) - offsetof( type, member )))
+
+/* Iterates pos over the links of the list, front to back.  The body may
+ * remove pos from the list, or free its item; tmp holds the next link. */
+#define ilist_foreach_safe( list, pos, tmp ) \
+  for( pos = ilist_first( list ), tmp = pos ? ilist_next( list, pos ) : NULL; \
+       pos; pos = tmp, tmp = pos ? ilist_next( list, pos ) : NULL )
+
+void ilist_init( struct ilist* );
+
+/* Is the list empty?  1 for yes, 0 for no */
+int ilist_empty( const struct ilist* );
+
+/* Is the link in a list?  1 for yes, 0 for no */
+int ilist_linked( const struct ilist_link* );
+
+/* Add a link that is in no list to the front or the back of the list. */
+void ilist_add_front( struct ilist*, struct ilist_link* );
+void ilist_add_back( struct ilist*, struct ilist_link* );
+
+/* Remove the link from the list it is in. */
+void ilist_remove( struct ilist*, struct ilist_link* );
+
+/* The first link, or the one after pos; NULL at the end of the list. */
+struct ilist_link* ilist_first( const struct ilist* );
+struct ilist_link* ilist_next( const struct ilist*, const struct ilist_link* pos );
+
 #endif /* CACHE_LINK_LIST_H_ */
 
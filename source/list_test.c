@@ -20,6 +20,22 @@ unsigned int finder( void* context, void* item ) {
   return *a == *b;
 }
 
+struct item {
+  int value;
+  struct ilist_link link;
+};
+
+/* Checks that the list holds the values, front to back */
+void check_order( struct ilist* l, const int* values, int n ) {
+  struct ilist_link* pos = ilist_first( l );
+  int i;
+  for( i = 0; i < n; ++i ) {
+    assert( pos && ilist_item( pos, struct item, link )->value == values[i] );
+    pos = ilist_next( l, pos );
+  }
+  assert( NULL == pos && n == l->size );
+}
+
 void my_dtor( void* item ) {
 
   /* Do some custom stuff.... */
@@ -61,6 +77,42 @@ int main() {
 
   link_list_destroy( l );
 
+  /* The intrusive list */
+  struct item items[6];
+  struct ilist il;
+  struct ilist_link* pos;
+  struct ilist_link* tmp;
+
+  ilist_init( &il );
+  assert( ilist_empty( &il ) && NULL == ilist_first( &il ));
+  for( i = 0; i < 6; ++i ) {
+    items[i].value = i;
+    ilist_add_back( &il, &items[i].link );
+  }
+  assert( ! ilist_empty( &il ));
+  check_order( &il, (int[]){ 0,1,2,3,4,5 }, 6 );
+
+  /* Removing from the back, the front and the middle; adding to the front */
+  ilist_remove( &il, &items[5].link );
+  assert( ! ilist_linked( &items[5].link ));
+  ilist_add_front( &il, &items[5].link );
+  assert( ilist_linked( &items[5].link ));
+  ilist_remove( &il, &items[4].link );
+  ilist_remove( &il, &items[2].link );
+  check_order( &il, (int[]){ 5,0,1,3 }, 4 );
+
+  /* Removing while iterating */
+  ilist_foreach_safe( &il, pos, tmp ) {
+    if( ilist_item( pos, struct item, link )->value % 2 ) {
+      ilist_remove( &il, pos );
+    }
+  }
+  check_order( &il, (int[]){ 0 }, 1 );
+  ilist_foreach_safe( &il, pos, tmp ) {
+    ilist_remove( &il, pos );
+  }
+  assert( ilist_empty( &il ) && 0 == il.size );
+
   return EXIT_SUCCESS;
 
 }
@@ -1,4 +1,4 @@
-/* 
+/*
  * File: network.c
  * Author: Alex Brodsky
  * Purpose: This file contains the network module to accept web connections.
@@ -6,6 +6,7 @@
  */
 
 
+#define _GNU_SOURCE                                     /* for accept4() */
 #include <stddef.h>
 #include <math.h>
 #include <stdio.h>
@@ -13,131 +14,557 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
 #include <errno.h>
 #include <unistd.h>
 #include <sys/wait.h>
-#include <sys/select.h>
-#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
 
 #include "network.h"
+#include "network_uring.h"
 
-static int serv_sock = -1;
+#define LISTENER_TAG ( (uint64_t)1 << 32 )              /* marks listeners */
 
-/* This function checks if there are any web clients waiting to connect.
- *    If one or more clients are waiting to connect, this function returns.
- *    Otherwise, this function puts the program to sleep (blocks) until
- *    a client connects.
- * Parameters: None
+static int serv_socks[NETWORK_MAX_LISTEN];              /* listening sockets */
+static int serv_ready[NETWORK_MAX_LISTEN];              /* accept() pending */
+static int num_serv = 0;                                /* listening sockets */
+static int num_ready = 0;                               /* ready listeners */
+static int next_serv = 0;                               /* next to accept on */
+static int epoll_fd = -1;                               /* the reactor */
+static int backend = NETWORK_EPOLL;                     /* epoll or io_uring */
+
+static int accepted[NETWORK_ACCEPT_BATCH];              /* last accept batch */
+static int num_accepted = 0;                            /* clients in batch */
+static int next_accepted = 0;                           /* next to hand out */
+
+static struct epoll_event batch[NETWORK_MAX_EVENTS];    /* last epoll batch */
+static int num_events = 0;                              /* events in batch */
+static int next_event = 0;                              /* next unhandled */
+
+
+/* These functions mark a listener as having (or not having) clients
+ *    waiting in its accept queue.
+ * Parameters:
+ *             idx : the listener number
  * Returns: None
  */
-extern void network_wait() {
+static void set_ready( int idx ) {
+  if( !serv_ready[idx] ) {
+    serv_ready[idx] = 1;
+    num_ready++;
+  }
+}
+
+static void clear_ready( int idx ) {
+  if( serv_ready[idx] ) {
+    serv_ready[idx] = 0;
+    num_ready--;
+  }
+}
+
+
+/* This function works like network_wait(), but gives up after timeout
+ *    milliseconds.  A timeout of 0 only collects events that are already
+ *    pending, and a timeout of -1 blocks like network_wait().
+ * Parameters:
+ *             timeout : the maximum time to sleep, in milliseconds
+ * Returns: The number of pending events, 0 if the timeout expired.
+ */
+extern int network_poll( int timeout ) {
   int n;                                                /* result var */
-  fd_set sel;                                           /* descriptor bits */
-  fd_set err;
-  
-  if( serv_sock < 0 ) {                                 /* sanity check */
+  int i;
+
+  if( backend == NETWORK_URING ) {
+    return uring_poll( timeout );
+  } else if( epoll_fd < 0 ) {                           /* sanity check */
     perror( "Error, network not initalized" );
     abort();
   }
 
-  FD_ZERO( &sel );                                      /* initialize bits */
-  FD_ZERO( &err );
-  FD_SET( serv_sock, &sel );
-  FD_SET( serv_sock, &err );
-
-  n = select( serv_sock + 1, &sel, NULL, &err, NULL );  /* wait for conn. */
+  if( next_event < num_events ) {                       /* still have some */
+    return num_events - next_event;
+  }
 
-  if( ( n <= 0 ) || FD_ISSET( serv_sock, &err ) ) {     /* check for errors */
+  if( num_ready || ( next_accepted < num_accepted ) ) {  /* clients waiting */
+    timeout = 0;                                        /* to be accepted */
+  }
+  num_events = next_event = 0;
+  n = epoll_wait( epoll_fd, batch, NETWORK_MAX_EVENTS, timeout );
+  if( n < 0 ) {                                         /* check for errors */
+    if( errno == EINTR ) {
+      return 0;
+    }
     perror( "Error occurred while waiting" );
     abort();
-  } 
+  }
+
+  for( i = 0; i < n; i++ ) {                            /* note listeners */
+    if( batch[i].data.u64 & LISTENER_TAG ) {
+      if( batch[i].events & EPOLLERR ) {
+        perror( "Error occurred on server socket" );
+        abort();
+      }
+      set_ready( (int)( batch[i].data.u64 & ~LISTENER_TAG ) );
+    }
+  }
+
+  num_events = n;
+  return n;
+}
+
+
+/* This function checks if there are any pending network events.  If there
+ *    are, this function returns.  Otherwise, this function puts the program
+ *    to sleep (blocks) until a client connects or a client socket becomes
+ *    ready, or a signal handler runs.
+ * Parameters: None
+ * Returns: None
+ */
+extern void network_wait() {
+  errno = 0;
+  if( backend == NETWORK_URING ) {
+    while( ( uring_poll( -1 ) <= 0 ) && ( errno != EINTR ) );  /* wait for event */
+    return;
+  }
+  while( !num_ready && ( next_accepted == num_accepted )/* wait for event */
+         && ( network_poll( -1 ) <= 0 ) && ( errno != EINTR ) );
+}
+
+
+/* This function starts watching a newly accepted client socket.
+ * Parameters:
+ *             sock : the client socket
+ * Returns: 0 on success, -1 on failure
+ */
+static int watch_client( int sock ) {
+  struct epoll_event ev;                                /* client events */
+
+  memset( &ev, 0, sizeof( ev ) );
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.fd = sock;
+  return epoll_ctl( epoll_fd, EPOLL_CTL_ADD, sock, &ev );
+}
+
+
+/* This function accepts up to max waiting clients, and never more than
+ *    NETWORK_ACCEPT_BATCH, taking turns between the ready listeners.  A
+ *    listener stays ready until its accept queue is drained.
+ * Parameters: max : the most clients to accept
+ * Returns: None
+ */
+static void accept_batch( int max ) {
+  int sock;                                             /* socket for client */
+  int idx;
+
+  if( max > NETWORK_ACCEPT_BATCH ) {
+    max = NETWORK_ACCEPT_BATCH;
+  }
+  num_accepted = next_accepted = 0;
+  while( num_ready && ( num_accepted < max ) ) {
+    idx = next_serv;
+    next_serv = ( next_serv + 1 ) % num_serv;
+    if( !serv_ready[idx] ) {
+      continue;
+    }
+
+    while( num_accepted < max ) {                       /* drain this one */
+      sock = accept4( serv_socks[idx], NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC );
+
+      if( sock >= 0 ) {
+        if( watch_client( sock ) ) {
+          perror( "Error while watching client socket" );
+          close( sock );
+        } else {
+          accepted[num_accepted++] = sock;
+        }
+      } else if( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) {
+        clear_ready( idx );                             /* queue is drained */
+        break;
+      } else if( ( errno != EINTR ) && ( errno != ECONNABORTED ) ) {
+        perror( "Error occurred on accept()" );         /* check for errors */
+        clear_ready( idx );
+        break;
+      }
+    }
+  }
 }
 
 
 /* This function checks if there are any web clients waiting to connect.
  *    If one or more clients are waiting to connect, this function opens
  *    a connection to the next client waiting to connect, and returns an
- *    integer file descriptor for the connection.  If no clients are 
- *    waiting, this function returns -1.
- * Parameters: None
+ *    integer file descriptor for the connection.  If no clients are
+ *    waiting, this function returns -1.  No more than max clients are
+ *    accepted from the listeners at a time, so that none is accepted that
+ *    the caller will not open; the rest wait in the accept queue.  With
+ *    io_uring the kernel has already accepted the clients, and the ones
+ *    left over are returned before any more events are reaped.
+ * Parameters: max : the most clients the caller will open before
+ *                   network_next() is called
  * Returns: A positive integer file decriptor to the next clients connection,
  *          or -1 if no client is waiting.
  */
-extern int network_open() {
-  struct sockaddr_in server;                            /* addr of client */
-  int len = sizeof( server );                           /* length of addr */
-  int n;                                                /* return var */
-  int sock = -1;                                        /* socket for client */
-  fd_set sel;                                           /* descriptor bits */
-  fd_set err;
-  struct timeval tv;                                    /* time to wait */
-  
-  if( serv_sock < 0 ) {                                 /* sanity check */
+extern int network_open( int max ) {
+  if( backend == NETWORK_URING ) {
+    return uring_open();
+  } else if( epoll_fd < 0 ) {                           /* sanity check */
     perror( "Error, network not initalized" );
     abort();
   }
 
-  FD_ZERO( &sel );                                      /* check for client */
-  FD_ZERO( &err );
-  FD_SET( serv_sock, &sel );
-  FD_SET( serv_sock, &err );
-  memset( &tv, 0, sizeof( tv ) );
-  n = select( serv_sock + 1, &sel, NULL, &err, &tv );
+  if( next_accepted == num_accepted ) {                 /* batch used up */
+    accept_batch( max );
+  }
+  if( next_accepted == num_accepted ) {                 /* nobody waiting */
+    return -1;
+  }
+  return accepted[next_accepted++];                     /* return client conn.*/
+}
 
-  if( ( n < 0 ) || FD_ISSET( serv_sock, &err ) ) {      /* check for errors */
-    perror( "Error occurred on select()" );
-    abort();
-  } else if( ( n > 0 ) && FD_ISSET( serv_sock, &sel ) ) { /* client is waiting*/
-    /* get client connection */
-    sock = accept( serv_sock, (struct sockaddr *)&server, (socklen_t *)&len );
 
-    if( sock < 0 ) {                                    /* check for errors */
-      perror( "Error occurred on select()" );
+/* This function returns the next client socket that has a pending event.
+ *    The events are a combination of NETWORK_READ, NETWORK_WRITE and
+ *    NETWORK_HANGUP.
+ * Parameters:
+ *             events : set to the events that happened on the socket
+ * Returns: The file descriptor of the client socket, or -1 if there are no
+ *          more pending events.
+ */
+extern int network_next( int *events ) {
+  struct epoll_event *ev;
+
+  if( backend == NETWORK_URING ) {
+    return uring_next( events );
+  }
+
+  while( next_event < num_events ) {
+    ev = &batch[next_event++];
+    if( ( ev->data.u64 & LISTENER_TAG ) || ( ev->data.fd < 0 ) ) {
+      continue;                                         /* not a client */
+    }
+
+    *events = 0;
+    if( ev->events & EPOLLIN ) {
+      *events |= NETWORK_READ;
+    }
+    if( ev->events & EPOLLOUT ) {
+      *events |= NETWORK_WRITE;
     }
+    if( ev->events & ( EPOLLERR | EPOLLHUP | EPOLLRDHUP ) ) {
+      *events |= NETWORK_HANGUP;
+    }
+    return ev->data.fd;
   }
-  return sock;                                          /* return client conn.*/
+  return -1;
 }
 
 
-/* This function initializes the network module and creates a server socket
- *   bound to a specified port.  This function will abort the program if an
- *   error occurs.
- * Parameters: 
- *             port : the port on which the server should listen.  Should be
- *                    between 1024 and 65525
+/* This function stops watching a client socket and closes it.
+ * Parameters:
+ *             fd : the client socket returned by network_open()
  * Returns: None
  */
-extern void network_init( int port ) {
+extern void network_close( int fd ) {
+  int i;
+
+  if( backend == NETWORK_URING ) {
+    uring_close( fd );
+    return;
+  }
+
+  for( i = next_event; i < num_events; i++ ) {          /* drop stale events */
+    if( batch[i].data.fd == fd ) {
+      batch[i].data.fd = -1;
+    }
+  }
+
+  epoll_ctl( epoll_fd, EPOLL_CTL_DEL, fd, NULL );
+  close( fd );
+}
+
+
+/* This function returns the address of the client on a socket.
+ * Parameters:
+ *             fd : the client socket returned by network_open()
+ * Returns: The IPv4 address of the client in host byte order, or 0 if it
+ *          is not known.
+ */
+extern unsigned int network_peer( int fd ) {
+  struct sockaddr_in peer;
+  socklen_t len = sizeof( peer );
+
+  if( getpeername( fd, (struct sockaddr *)&peer, &len ) ||
+      ( peer.sin_family != AF_INET ) ) {
+    return 0;
+  }
+  return ntohl( peer.sin_addr.s_addr );
+}
+
+
+/* This function returns how much a client socket can take right away, as
+ *    the size of its send buffer less what is queued in it and not yet
+ *    acknowledged.  This is the most a non-blocking write can send, and
+ *    it goes up as fast as the client reads.
+ * Parameters:
+ *             fd : the client socket returned by network_open()
+ * Returns: The free space in bytes, or -1 if it is not known.
+ */
+extern int network_send_space( int fd ) {
+  int size;
+  int queued;
+  socklen_t len = sizeof( size );
+
+  if( getsockopt( fd, SOL_SOCKET, SO_SNDBUF, &size, &len ) ||
+      ioctl( fd, SIOCOUTQ, &queued ) ) {
+    return -1;
+  }
+  return ( size > queued ) ? size - queued : 0;
+}
+
+
+/* This function watches another descriptor, such as an eventfd, for input.
+ *    It is reported by network_next() like a client socket.  Only the epoll
+ *    backend supports this.
+ * Parameters:
+ *             fd : the descriptor to watch
+ * Returns: 0 on success, -1 on failure
+ */
+extern int network_watch( int fd ) {
+  struct epoll_event ev;
+
+  if( backend == NETWORK_URING ) {
+    errno = EOPNOTSUPP;
+    return -1;
+  }
+  memset( &ev, 0, sizeof( ev ) );
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.fd = fd;
+  return epoll_ctl( epoll_fd, EPOLL_CTL_ADD, fd, &ev );
+}
+
+
+/* This function reads the request sent by a client, like read().
+ * Parameters:
+ *             fd : the client socket
+ *             buf : where to store the data
+ *             len : the size of buf
+ * Returns: The number of bytes read, 0 if the client closed the connection,
+ *          or -1 on error.  errno is EAGAIN if no data is available yet.
+ */
+extern int network_read( int fd, char *buf, int len ) {
+  if( backend == NETWORK_URING ) {
+    return uring_read( fd, buf, len );
+  }
+  return read( fd, buf, len );
+}
+
+
+/* This function sends up to len bytes of buf to a client, like write().
+ *    See network.h for how this works with io_uring.
+ * Parameters:
+ *             fd : the client socket
+ *             buf : the data to send
+ *             len : the number of bytes to send
+ * Returns: The number of bytes sent, or -1 on error.  errno is EAGAIN if the
+ *          socket is full.
+ */
+extern int network_write( int fd, const char *buf, int len ) {
+  if( backend == NETWORK_URING ) {
+    return uring_write( fd, buf, len );
+  }
+  return send( fd, buf, len, MSG_NOSIGNAL );
+}
+
+
+/* This function sends up to len bytes of a file, starting at offset, to a
+ *    client.  See network.h for how this works with io_uring.
+ * Parameters:
+ *             fd : the client socket
+ *             file : the file descriptor of the file to send
+ *             offset : where in the file to start
+ *             len : the number of bytes to send
+ * Returns: The number of bytes sent, or -1 on error.  errno is EAGAIN if the
+ *          socket is full.
+ */
+extern int network_send_file( int fd, int file, long offset, int len ) {
+  off_t off = offset;
+
+  if( backend == NETWORK_URING ) {
+    return uring_send_file( fd, file, offset, len );
+  }
+  return sendfile( fd, file, &off, len );
+}
+
+
+/* This function returns the result of the io_uring transfer that finished
+ *    on a client socket, when NETWORK_WRITE is reported for it.
+ * Parameters:
+ *             fd : the client socket
+ * Returns: The number of bytes sent, 0 at the end of the file, or -1 on
+ *          error (errno is set).
+ */
+extern int network_sent( int fd ) {
+  if( backend == NETWORK_URING ) {
+    return uring_sent( fd );
+  }
+  errno = EINVAL;                                       /* epoll is synchronous */
+  return -1;
+}
+
+
+/* This function selects the backend used by network_init().
+ * Parameters:
+ *             which : NETWORK_EPOLL or NETWORK_URING
+ * Returns: None
+ */
+extern void network_set_backend( int which ) {
+  backend = which;
+}
+
+
+/* This function returns the backend in use.
+ * Parameters: None
+ * Returns: NETWORK_EPOLL or NETWORK_URING
+ */
+extern int network_backend() {
+  return backend;
+}
+
+
+/* This function creates one listening socket bound to port, adds it to the
+ *   reactor and returns its descriptor.  This function will abort the program
+ *   if an error occurs.
+ * Parameters:
+ *             port : the port on which the server should listen
+ *             idx : the listener number, used to tag its events
+ *             reuseport : 1 if the port is shared with other listeners
+ *             backlog : the length of the accept queue
+ *             defer : TCP_DEFER_ACCEPT timeout in seconds, 0 for none
+ * Returns: The listening socket
+ */
+static int create_listener( int port, int idx, int reuseport, int backlog,
+                            int defer ) {
   struct sockaddr_in self;                             /* socket address */
+  struct epoll_event ev;                               /* listener events */
   int yes = 1;                                         /* config variable */
-  
-  serv_sock = socket( PF_INET, SOCK_STREAM, 0 );       /* create socket */
-  if( serv_sock < 0 ) {
+  int sock;
+
+  sock = socket( PF_INET, SOCK_STREAM | SOCK_CLOEXEC |
+                 ( epoll_fd >= 0 ? SOCK_NONBLOCK : 0 ), 0 );
+  if( sock < 0 ) {
     perror( "Error while creating server socket" );
     abort();
-  } 
+  }
 
                                                        /* configure socket */
-  setsockopt( serv_sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof( int ) );
-  setsockopt( serv_sock, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof( int ) );
+  setsockopt( sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof( int ) );
+  setsockopt( sock, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof( int ) );
+  if( reuseport &&
+      setsockopt( sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof( int ) ) ) {
+    perror( "Error while setting SO_REUSEPORT" );
+    abort();
+  }
+  if( ( defer > 0 ) &&
+      setsockopt( sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer, sizeof( int ) ) ) {
+    perror( "Error while setting TCP_DEFER_ACCEPT" );  /* not fatal */
+  }
 
-  self.sin_family = AF_INET;                           /* bind socket to port */
+  memset( &self, 0, sizeof( self ) );                  /* bind socket to port */
+  self.sin_family = AF_INET;
   self.sin_addr.s_addr = htonl( INADDR_ANY );
   self.sin_port = htons( port );
-  if( bind( serv_sock, (struct sockaddr *)&self, sizeof( self ) ) )  {
+  if( bind( sock, (struct sockaddr *)&self, sizeof( self ) ) )  {
     perror( "Error on bind()" );
     abort();
   }
 
-  if( listen( serv_sock, 64 ) ) {                      /* allow connections */
+  if( listen( sock, backlog ) ) {                      /* allow connections */
     perror( "Error on listen()" );
     abort();
   }
+
+  if( epoll_fd < 0 ) {                                 /* io_uring accepts */
+    return sock;
+  }
+
+  memset( &ev, 0, sizeof( ev ) );                      /* watch listener */
+  ev.events = EPOLLIN | EPOLLET;
+  ev.data.u64 = LISTENER_TAG | idx;
+  if( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, sock, &ev ) ) {
+    perror( "Error while watching server socket" );
+    abort();
+  }
+  return sock;
 }
 
 
+/* This function initializes the network module like network_init(), but
+ *   creates one SO_REUSEPORT server socket per listener.  This function will
+ *   abort the program if an error occurs.
+ * Parameters:
+ *             port : the port on which the server should listen.  Should be
+ *                    between 1024 and 65525
+ *             listeners : the number of server sockets, between 1 and
+ *                    NETWORK_MAX_LISTEN
+ *             backlog : the length of each server socket's accept queue
+ *             defer : if positive, clients are only accepted once their
+ *                    request has arrived, or after defer seconds
+ *                    (TCP_DEFER_ACCEPT).  0 turns this off.
+ * Returns: None
+ */
+extern void network_init_listeners( int port, int listeners, int backlog,
+                                    int defer ) {
+  int i;
 
+  if( ( listeners < 1 ) || ( listeners > NETWORK_MAX_LISTEN ) ) {
+    fprintf( stderr, "Error, between 1 and %d listeners are supported\n",
+             NETWORK_MAX_LISTEN );
+    abort();
+  }
 
+  if( backend == NETWORK_URING ) {                     /* try io_uring */
+    for( i = 0; i < listeners; i++ ) {
+      serv_socks[i] = create_listener( port, i, listeners > 1, backlog, defer );
+    }
+    num_serv = listeners;
+    if( !uring_init( serv_socks, num_serv ) ) {
+      return;
+    }
+    fprintf( stderr, "io_uring is not available, using epoll\n" );
+    for( i = 0; i < listeners; i++ ) {
+      close( serv_socks[i] );
+    }
+    backend = NETWORK_EPOLL;
+  }
+
+  epoll_fd = epoll_create1( EPOLL_CLOEXEC );           /* create reactor */
+  if( epoll_fd < 0 ) {
+    perror( "Error while creating epoll instance" );
+    abort();
+  }
+
+  for( i = 0; i < listeners; i++ ) {                   /* create listeners */
+    serv_socks[i] = create_listener( port, i, listeners > 1, backlog, defer );
+    serv_ready[i] = 0;
+  }
+  num_serv = listeners;
+}
 
+
+/* This function initializes the network module and creates a server socket
+ *   bound to a specified port.  This function will abort the program if an
+ *   error occurs.
+ * Parameters:
+ *             port : the port on which the server should listen.  Should be
+ *                    between 1024 and 65525
+ * Returns: None
+ */
+extern void network_init( int port ) {
+  network_init_listeners( port, 1, NETWORK_BACKLOG, 0 );
+}
@@ -1,4 +1,4 @@
-/* 
+/*
  * File: network.h
  * Author: Alex Brodsky
  * Purpose: This file contains the prototypes and describes how to use network
@@ -10,31 +10,96 @@
 
 #include <stdio.h>
 
-/* 
- * This module has three functions:
- *   network_init() : inititalizes the module
- *   network_wait() : wait until a client connects
- *   network_open() : open the next client connection
+#define NETWORK_MAX_EVENTS  256         /* events fetched per epoll_wait() */
+#define NETWORK_MAX_LISTEN  64          /* most SO_REUSEPORT listeners */
+#define NETWORK_BACKLOG     64          /* default listen() backlog */
+#define NETWORK_ACCEPT_BATCH 64         /* clients accepted per batch */
+
+#define NETWORK_EPOLL       0           /* readiness backend (default) */
+#define NETWORK_URING       1           /* io_uring completion backend */
+
+#define NETWORK_URING_ENTRIES 1024      /* io_uring submission queue size */
+#define NETWORK_URING_ACCEPTS 8         /* accepts in flight per listener */
+#define NETWORK_URING_BUFFERS 64        /* registered transfer buffers */
+#define NETWORK_URING_BUFSIZE 65536     /* size of each transfer buffer */
+#define NETWORK_URING_RECVSIZE 8192     /* size of each request read */
+#define NETWORK_URING_FILES 4096        /* size of the fixed file table */
+
+#define NETWORK_READ        0x1         /* client socket has data to read */
+#define NETWORK_WRITE       0x2         /* client socket can take more data */
+#define NETWORK_HANGUP      0x4         /* client closed or socket errored */
+
+/*
+ * This module is an edge-triggered epoll reactor.  It owns the listening
+ * socket and every client socket, all of which are in non-blocking mode.
+ * It has the following functions:
+ *   network_init()  : inititalizes the module
+ *   network_init_listeners() : inititalizes the module with N listeners
+ *   network_wait()  : wait until a client connects or a client socket is ready
+ *   network_poll()  : like network_wait(), but with a timeout
+ *   network_open()  : open the next client connection
+ *   network_next()  : get the next client socket with a readiness event
+ *   network_close() : close a client connection
+ *   network_peer()  : get the address of a client
+ *   network_send_space() : get the free space in a client's send buffer
+ *   network_watch() : watch another descriptor, such as an eventfd
+ *   network_read()  : read request bytes from a client
+ *   network_write() : send bytes to a client
+ *   network_send_file() : send part of a file to a client
+ *   network_sent()  : get the result of a finished network_send_file()
+ *   network_set_backend() / network_backend() : choose epoll or io_uring
  *
- * The network_init() function should be called once, at the start of the 
- * program.  This function will create a socket to which web clients can 
- * connect.
+ * The network_init() function should be called once, at the start of the
+ * program.  This function will create a socket to which web clients can
+ * connect.  network_init_listeners() can be called instead to create several
+ * SO_REUSEPORT sockets on the same port, so that the kernel spreads incoming
+ * connections over several accept queues.
  *
- * The network_wait() function should be called when there are no more web
- * clients waiting to connect.  This function will put the program to sleep 
- * until one or more web clients connects.  Once one or web client connect,
- * this function returns and your program can accept the connections.
+ * The network_wait() function should be called when there is no more work
+ * to do.  This function will put the program to sleep until one or more web
+ * clients connects or an open client socket becomes readable or writable.
+ * Once that happens, this function returns and your program can accept the
+ * connections and handle the events.
  *
  * The network_open() function opens a waiting web client connection and
- * returns an integer file descriptor.  If no clients are waiting, this 
- * function returns -1.
+ * returns an integer file descriptor.  If no clients are waiting, this
+ * function returns -1.  The returned socket is non-blocking and is watched
+ * by the reactor from then on.  Clients are accepted from each ready
+ * listener in batches of up to NETWORK_ACCEPT_BATCH, or as many as the
+ * caller of network_open() asks for, and handed out one at a time.
+ *
+ * The network_next() function returns the next client socket that had an
+ * event in the last network_wait(), or -1 once all events are handled.
+ * Because the reactor is edge-triggered, a socket is only reported again
+ * after a read() or write() on it has returned EAGAIN.
+ *
+ * The network_close() function must be used instead of close() for client
+ * sockets, so that no stale events are reported for the descriptor.
+ *
+ * Requests should be read with network_read(), and responses sent with
+ * network_write() and network_send_file(), so that the same program works
+ * with either backend.
+ * With epoll (the default) these are plain non-blocking system calls.  If
+ * network_set_backend( NETWORK_URING ) is called before network_init(), the
+ * module uses io_uring instead, if the kernel supports it, and falls back to
+ * epoll otherwise.  With io_uring:
+ *   - accepts, request reads and file transfers are queued and handed to
+ *     the kernel in one batch by network_wait(), which also collects all
+ *     finished operations in one batch.
+ *   - NETWORK_READ means a request read has finished, and network_read()
+ *     returns its data.  When network_read() returns EAGAIN, another read
+ *     is started and NETWORK_READ is reported again once it finishes.
+ *   - network_write() and network_send_file() only start the transfer
+ *     (errno EINPROGRESS).
+ *     NETWORK_WRITE is reported when it has finished, and network_sent()
+ *     then returns the number of bytes that were sent.
  */
 
 
 /* This function initializes the network module and creates a server socket
  *   bound to a specified port.  This function will abort the program if an
  *   error occurs.
- * Parameters: 
+ * Parameters:
  *             port : the port on which the server should listen.  Should be
  *                    between 1024 and 65525
  * Returns: None
@@ -42,25 +107,178 @@
 extern void network_init( int port );
 
 
-/* This function checks if there are any web clients waiting to connect.
- *    If one or more clients are waiting to connect, this function returns.
- *    Otherwise, this function puts the program to sleep (blocks) until
- *    a client connects.
+/* This function initializes the network module like network_init(), but
+ *   creates one SO_REUSEPORT server socket per listener.  The kernel
+ *   spreads new clients between the sockets, and their accept queues fill
+ *   separately, but network_open() accepts from all of them on the calling
+ *   thread.  This function will abort the program if an error occurs.
+ * Parameters:
+ *             port : the port on which the server should listen.  Should be
+ *                    between 1024 and 65525
+ *             listeners : the number of server sockets, between 1 and
+ *                    NETWORK_MAX_LISTEN
+ *             backlog : the length of each server socket's accept queue
+ *             defer : if positive, clients are only accepted once their
+ *                    request has arrived, or after defer seconds
+ *                    (TCP_DEFER_ACCEPT).  0 turns this off.
+ * Returns: None
+ */
+extern void network_init_listeners( int port, int listeners, int backlog,
+                                    int defer );
+
+
+/* This function checks if there are any pending network events.  If there
+ *    are, this function returns.  Otherwise, this function puts the program
+ *    to sleep (blocks) until a client connects or a client socket becomes
+ *    ready, or a signal handler runs.
  * Parameters: None
  * Returns: None
  */
 extern void network_wait();
 
 
+/* This function works like network_wait(), but gives up after timeout
+ *    milliseconds.  A timeout of 0 only collects events that are already
+ *    pending, and a timeout of -1 blocks like network_wait().
+ * Parameters:
+ *             timeout : the maximum time to sleep, in milliseconds
+ * Returns: The number of pending events, 0 if the timeout expired.
+ */
+extern int network_poll( int timeout );
+
+
 /* This function checks if there are any web clients waiting to connect.
  *    If one or more clients are waiting to connect, this function opens
  *    a connection to the next client waiting to connect, and returns an
- *    integer file descriptor for the connection.  If no clients are 
- *    waiting, this function returns -1.
- * Parameters: None
+ *    integer file descriptor for the connection.  If no clients are
+ *    waiting, this function returns -1.  No more than max clients are
+ *    accepted from the listeners at a time, so that none is accepted that
+ *    the caller will not open; the rest wait in the accept queue.  With
+ *    io_uring the kernel has already accepted the clients, and the ones
+ *    left over are returned before any more events are reaped.
+ * Parameters: max : the most clients the caller will open before
+ *                   network_next() is called
  * Returns: A positive integer file decriptor to the next clients connection,
  *          or -1 if no client is waiting.
  */
-extern int network_open();
+extern int network_open( int max );
+
+
+/* This function returns the next client socket that has a pending event.
+ *    The events are a combination of NETWORK_READ, NETWORK_WRITE and
+ *    NETWORK_HANGUP.
+ * Parameters:
+ *             events : set to the events that happened on the socket
+ * Returns: The file descriptor of the client socket, or -1 if there are no
+ *          more pending events.
+ */
+extern int network_next( int *events );
+
+
+/* This function stops watching a client socket and closes it.
+ * Parameters:
+ *             fd : the client socket returned by network_open()
+ * Returns: None
+ */
+extern void network_close( int fd );
+
+
+/* This function returns the address of the client on a socket.
+ * Parameters:
+ *             fd : the client socket returned by network_open()
+ * Returns: The IPv4 address of the client in host byte order, or 0 if it
+ *          is not known.
+ */
+extern unsigned int network_peer( int fd );
+
+
+/* This function returns how much a client socket can take right away, as
+ *    the size of its send buffer less what is queued in it and not yet
+ *    acknowledged.
+ * Parameters:
+ *             fd : the client socket returned by network_open()
+ * Returns: The free space in bytes, or -1 if it is not known.
+ */
+extern int network_send_space( int fd );
+
+
+/* This function selects the backend used by network_init().  It must be
+ *    called before network_init() or network_init_listeners().
+ * Parameters:
+ *             backend : NETWORK_EPOLL or NETWORK_URING
+ * Returns: None
+ */
+extern void network_set_backend( int backend );
+
+
+/* This function returns the backend in use, which is NETWORK_EPOLL if
+ *    NETWORK_URING was asked for but is not supported by the kernel.
+ * Parameters: None
+ * Returns: NETWORK_EPOLL or NETWORK_URING
+ */
+extern int network_backend();
+
+
+/* This function watches another descriptor, such as an eventfd, for input.
+ *    Once it is readable, it is reported by network_next() like a client
+ *    socket, with NETWORK_READ set.  Like client sockets it is edge-triggered.
+ *    Only the epoll backend supports this.
+ * Parameters:
+ *             fd : the descriptor to watch
+ * Returns: 0 on success, -1 on failure
+ */
+extern int network_watch( int fd );
+
+
+/* This function reads the request sent by a client, like read().
+ * Parameters:
+ *             fd : the client socket
+ *             buf : where to store the data
+ *             len : the size of buf
+ * Returns: The number of bytes read, 0 if the client closed the connection,
+ *          or -1 on error.  errno is EAGAIN if no data is available yet.
+ */
+extern int network_read( int fd, char *buf, int len );
+
+
+/* This function sends up to len bytes of buf to a client, like write().
+ *    With io_uring, the data is copied and queued like network_send_file()
+ *    does.
+ * Parameters:
+ *             fd : the client socket
+ *             buf : the data to send
+ *             len : the number of bytes to send
+ * Returns: The number of bytes sent, or -1 on error.  errno is EAGAIN if the
+ *          socket is full.
+ */
+extern int network_write( int fd, const char *buf, int len );
+
+
+/* This function sends up to len bytes of a file, starting at offset, to a
+ *    client.  With epoll, the data is sent right away with sendfile().
+ *    With io_uring, the transfer is queued and this function fails with
+ *    errno set to EINPROGRESS; see network_sent().  At most
+ *    NETWORK_URING_BUFSIZE bytes are sent per transfer, and only one
+ *    transfer per client can be in progress.  If all the transfer buffers
+ *    are in use, the function fails with errno set to EBUSY.
+ * Parameters:
+ *             fd : the client socket
+ *             file : the file descriptor of the file to send
+ *             offset : where in the file to start
+ *             len : the number of bytes to send
+ * Returns: The number of bytes sent, or -1 on error.  errno is EAGAIN if the
+ *          socket is full.
+ */
+extern int network_send_file( int fd, int file, long offset, int len );
+
+
+/* This function returns the result of the io_uring transfer that finished
+ *    on a client socket, when NETWORK_WRITE is reported for it.
+ * Parameters:
+ *             fd : the client socket
+ * Returns: The number of bytes sent, 0 at the end of the file, or -1 on
+ *          error (errno is set).
+ */
+extern int network_sent( int fd );
 
 #endif
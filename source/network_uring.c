@@ -0,0 +1,791 @@
+/*
+ * File: network_uring.c
+ * Purpose: This file contains the io_uring backend of the network module.
+ *          Accepts, request reads and file-to-socket transfers are queued as
+ *          submissions and handed to the kernel in one io_uring_enter() per
+ *          network_poll(), which also reaps all completions that are ready.
+ *          Listening and client sockets are registered as fixed files,
+ *          file transfers read into and write from registered buffers, and
+ *          each descriptor keeps the buffer its requests are read into.
+ *          There is no liburing dependency; the ring is set up by hand.
+ */
+
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "network.h"
+#include "network_uring.h"
+
+#define OP_ACCEPT   1                                   /* listener accept */
+#define OP_RECV     2                                   /* request read */
+#define OP_READ     3                                   /* file -> buffer */
+#define OP_WRITE    4                                   /* buffer -> client */
+
+/* One of these for every submission in flight; its address is the
+ * submission's user_data.
+ */
+struct uring_op {
+  int type;                                             /* OP_ value */
+  int idx;                                              /* listener or slot */
+  int fd;                                               /* client socket */
+  unsigned gen;                                         /* fd generation */
+};
+
+/* The read of a client socket, and the buffer it reads into.  One is
+ * allocated for each descriptor the first time it is read, and reused by
+ * every later client that gets the descriptor.  A read that was cancelled
+ * still owns it until its completion is reaped.
+ */
+struct uring_recv {
+  struct uring_op op;                                   /* first, for reap() */
+  int busy;                                             /* op in flight */
+  char buf[NETWORK_URING_RECVSIZE];
+};
+
+/* A file-to-socket transfer; one per registered buffer */
+struct uring_xfer {
+  struct uring_op read_op;                              /* linked pair */
+  struct uring_op write_op;
+  int busy;                                             /* slot in use */
+  int len;                                              /* bytes requested */
+  int result;                                           /* bytes sent or -err */
+  int outstanding;                                      /* ops not reaped */
+};
+
+/* The backend's view of a client socket, indexed by descriptor */
+struct uring_conn {
+  unsigned gen;                                         /* bumped on close */
+  int fixed;                                            /* in file table */
+  struct uring_recv *rx;                                /* kept across clients */
+  int reading;                                          /* read submitted */
+  int xfer;                                             /* transfer or -1 */
+  char *data;                                           /* unread request */
+  int data_len;
+  int data_off;
+  int eof;                                              /* peer closed */
+  int err;                                              /* read errno */
+  int sent;                                             /* transfer result */
+};
+
+struct uring_event {
+  int fd;
+  int events;
+};
+
+/* The submission and completion rings, mapped from the kernel */
+static int ring_fd = -1;
+static unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+static unsigned sq_entries;
+static unsigned sq_local;                               /* our tail */
+static struct io_uring_sqe *sqes;
+static unsigned *cq_head, *cq_tail, *cq_mask;
+static struct io_uring_cqe *cqes;
+static int ext_arg = 0;                                 /* timeouts allowed */
+
+static int *serv_socks;                                 /* listening sockets */
+static int num_serv = 0;
+static struct uring_op accept_ops[NETWORK_MAX_LISTEN * NETWORK_URING_ACCEPTS];
+
+static char *xfer_mem = NULL;                           /* registered buffers */
+static struct uring_xfer xfers[NETWORK_URING_BUFFERS];
+static int free_xfers[NETWORK_URING_BUFFERS];           /* stack of free slots */
+static int num_free_xfers = 0;
+
+static struct uring_conn *conns = NULL;                 /* per-socket state */
+static int num_conns = 0;
+
+static int accepted[NETWORK_MAX_EVENTS];                /* new clients */
+static int num_accepted = 0;
+static int next_accepted = 0;
+
+static struct uring_event events[NETWORK_MAX_EVENTS];   /* completed I/O */
+static int num_events = 0;
+static int next_event = 0;
+
+
+/* Thin wrappers for the io_uring system calls, which glibc does not have */
+static int sys_setup( unsigned entries, struct io_uring_params *p ) {
+  return (int)syscall( __NR_io_uring_setup, entries, p );
+}
+
+static int sys_enter( unsigned submit, unsigned wait, unsigned flags,
+                      void *arg, size_t argsz ) {
+  return (int)syscall( __NR_io_uring_enter, ring_fd, submit, wait, flags, arg,
+                       argsz );
+}
+
+static int sys_register( unsigned opcode, void *arg, unsigned nr ) {
+  return (int)syscall( __NR_io_uring_register, ring_fd, opcode, arg, nr );
+}
+
+
+/* This function returns the backend state of a client socket, growing the
+ *   table as needed.  It aborts if memory cannot be allocated.
+ */
+static struct uring_conn *get_conn( int fd ) {
+  if( fd >= num_conns ) {
+    int size = num_conns ? num_conns : 64;
+    struct uring_conn *tmp;
+    int i;
+
+    while( size <= fd ) {
+      size *= 2;
+    }
+    tmp = realloc( conns, size * sizeof( struct uring_conn ) );
+    if( !tmp ) {
+      perror( "Error while allocating memory" );
+      abort();
+    }
+    memset( tmp + num_conns, 0, ( size - num_conns ) * sizeof( *tmp ) );
+    for( i = num_conns; i < size; i++ ) {
+      tmp[i].xfer = -1;
+    }
+    conns = tmp;
+    num_conns = size;
+  }
+  return &conns[fd];
+}
+
+
+/* This function hands queued submissions to the kernel and optionally waits
+ *   for completions.
+ * Parameters:
+ *             timeout : -1 to wait for one completion, 0 not to wait, or the
+ *                       longest time to wait in milliseconds
+ * Returns: 0 on success, -1 on error (errno is set)
+ */
+static int submit( int timeout ) {
+  unsigned pending = sq_local - *sq_tail;
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec ts;
+  unsigned flags = 0;
+  unsigned wait = 0;
+  int n;
+
+  __atomic_store_n( sq_tail, sq_local, __ATOMIC_RELEASE );
+
+  if( timeout != 0 ) {
+    flags |= IORING_ENTER_GETEVENTS;
+    wait = 1;
+  }
+  if( ( timeout > 0 ) && ext_arg ) {
+    memset( &arg, 0, sizeof( arg ) );
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = ( timeout % 1000 ) * 1000000L;
+    arg.ts = (unsigned long)&ts;
+    flags |= IORING_ENTER_EXT_ARG;
+    n = sys_enter( pending, wait, flags, &arg, sizeof( arg ) );
+  } else {
+    n = sys_enter( pending, wait, flags, NULL, 0 );
+  }
+
+  if( ( n < 0 ) && ( errno != EINTR ) && ( errno != ETIME ) &&
+      ( errno != EBUSY ) ) {
+    return -1;
+  }
+  return 0;
+}
+
+
+/* This function returns the next free submission entry, first handing the
+ *   queued ones to the kernel if the ring is full.
+ * Parameters:
+ *             need : the number of entries that must be free, so that
+ *                    linked submissions are never split
+ * Returns: A zeroed submission entry
+ */
+static struct io_uring_sqe *get_sqe( unsigned need ) {
+  struct io_uring_sqe *sqe;
+  unsigned idx;
+
+  while( sq_local + need -
+         __atomic_load_n( sq_head, __ATOMIC_ACQUIRE ) > sq_entries ) {
+    if( submit( 0 ) ) {
+      perror( "Error while submitting to io_uring" );
+      abort();
+    }
+  }
+
+  idx = sq_local & *sq_mask;
+  sqe = &sqes[idx];
+  memset( sqe, 0, sizeof( *sqe ) );
+  sq_array[idx] = idx;
+  sq_local++;
+  return sqe;
+}
+
+
+/* This function points a submission at a socket, using the fixed file
+ *   table when the socket is registered.
+ */
+static void set_file( struct io_uring_sqe *sqe, int fd, int fixed ) {
+  sqe->fd = fd;
+  if( fixed ) {
+    sqe->flags |= IOSQE_FIXED_FILE;
+  }
+}
+
+
+/* This function adds a socket to the fixed file table, at its own
+ *   descriptor number, if the table is big enough.
+ * Returns: 1 if the socket is now a fixed file, 0 if not
+ */
+static int register_file( int fd, int value ) {
+  struct io_uring_files_update up;
+
+  if( fd >= NETWORK_URING_FILES ) {
+    return 0;
+  }
+  memset( &up, 0, sizeof( up ) );
+  up.offset = fd;
+  up.fds = (unsigned long)&value;
+  return sys_register( IORING_REGISTER_FILES_UPDATE, &up, 1 ) == 1;
+}
+
+
+static void submit_accept( struct uring_op *op ) {
+  struct io_uring_sqe *sqe = get_sqe( 1 );
+
+  sqe->opcode = IORING_OP_ACCEPT;
+  set_file( sqe, serv_socks[op->idx], serv_socks[op->idx] < NETWORK_URING_FILES );
+  sqe->accept_flags = SOCK_CLOEXEC;
+  sqe->user_data = (unsigned long)op;
+}
+
+
+static void start_recv( int fd, struct uring_conn *c ) {
+  struct uring_recv *rx = c->rx;
+  struct io_uring_sqe *sqe = get_sqe( 1 );
+
+  rx->op.type = OP_RECV;
+  rx->op.fd = fd;
+  rx->op.gen = c->gen;
+  rx->busy = 1;
+
+  sqe->opcode = IORING_OP_RECV;
+  set_file( sqe, fd, c->fixed );
+  sqe->addr = (unsigned long)rx->buf;
+  sqe->len = NETWORK_URING_RECVSIZE;
+  sqe->user_data = (unsigned long)&rx->op;
+}
+
+
+/* This function reads the next request data of a client.  If the read of
+ *   the last client of the descriptor was cancelled but has not completed
+ *   yet, this one starts when it does.
+ */
+static void submit_recv( int fd ) {
+  struct uring_conn *c = get_conn( fd );
+
+  if( !c->rx ) {
+    c->rx = malloc( sizeof( struct uring_recv ) );
+    if( !c->rx ) {
+      perror( "Error while allocating memory" );
+      abort();
+    }
+    c->rx->busy = 0;
+  }
+  c->reading = 1;
+  if( !c->rx->busy ) {
+    start_recv( fd, c );
+  }
+}
+
+
+static void submit_write( int slot, int len ) {
+  struct uring_xfer *x = &xfers[slot];
+  struct uring_conn *c = get_conn( x->write_op.fd );
+  struct io_uring_sqe *sqe = get_sqe( 1 );
+
+  sqe->opcode = IORING_OP_WRITE_FIXED;
+  set_file( sqe, x->write_op.fd, c->fixed );
+  sqe->addr = (unsigned long)( xfer_mem + slot * NETWORK_URING_BUFSIZE );
+  sqe->len = len;
+  sqe->buf_index = slot;
+  sqe->user_data = (unsigned long)&x->write_op;
+  x->outstanding++;
+}
+
+
+static void submit_cancel( struct uring_op *target ) {
+  struct io_uring_sqe *sqe = get_sqe( 1 );
+
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = (unsigned long)target;
+  sqe->user_data = 0;                                   /* result ignored */
+}
+
+
+static void push_event( int fd, int ev ) {
+  events[num_events].fd = fd;
+  events[num_events].events = ev;
+  num_events++;
+}
+
+
+/* These functions handle one completion of each kind of submission */
+static void complete_accept( struct uring_op *op, int res ) {
+  struct uring_conn *c;
+
+  if( res >= 0 ) {
+    c = get_conn( res );
+    c->fixed = register_file( res, res );
+    c->reading = 0;
+    c->xfer = -1;
+    c->data = NULL;
+    c->data_len = c->data_off = 0;
+    c->eof = c->err = c->sent = 0;
+    accepted[num_accepted++] = res;
+    submit_recv( res );                                 /* wait for request */
+  } else if( ( res != -EINTR ) && ( res != -ECONNABORTED ) &&
+             ( res != -EAGAIN ) ) {
+    errno = -res;
+    perror( "Error occurred on accept()" );
+  }
+  submit_accept( op );                                  /* keep accepting */
+}
+
+
+static void complete_recv( struct uring_op *op, int res ) {
+  struct uring_recv *rx = (struct uring_recv *)op;
+  struct uring_conn *c = get_conn( op->fd );
+
+  rx->busy = 0;
+  if( op->gen != c->gen ) {                             /* socket was closed */
+    if( c->reading ) {                                  /* and reused */
+      start_recv( op->fd, c );
+    }
+    return;
+  }
+
+  c->reading = 0;
+  if( res > 0 ) {
+    c->data = rx->buf;
+    c->data_len = res;
+    c->data_off = 0;
+    push_event( op->fd, NETWORK_READ );
+  } else {
+    if( res == 0 ) {
+      c->eof = 1;
+    } else {
+      c->err = -res;
+    }
+    push_event( op->fd, NETWORK_READ | NETWORK_HANGUP );
+  }
+}
+
+
+static void complete_xfer( struct uring_op *op, int res ) {
+  struct uring_xfer *x = &xfers[op->idx];
+  struct uring_conn *c = get_conn( op->fd );
+  int stale = ( op->gen != c->gen );
+
+  x->outstanding--;
+  if( op->type == OP_READ ) {
+    if( ( res > 0 ) && ( res < x->len ) && !stale ) {
+      submit_write( op->idx, res );                     /* short read: the */
+    } else if( res <= 0 ) {                             /* linked write is */
+      x->result = res;                                  /* being cancelled */
+    }
+  } else if( res != -ECANCELED ) {
+    x->result = res;
+  }
+
+  if( x->outstanding > 0 ) {
+    return;
+  }
+  if( !stale ) {
+    c->xfer = -1;
+    c->sent = x->result;
+    push_event( op->fd, NETWORK_WRITE );
+  }
+  x->busy = 0;
+  free_xfers[num_free_xfers++] = op->idx;
+}
+
+
+/* This function reaps every completion that is ready, turning them into
+ *   accepted clients and events.
+ */
+static void reap() {
+  unsigned head = *cq_head;
+  unsigned tail = __atomic_load_n( cq_tail, __ATOMIC_ACQUIRE );
+  struct io_uring_cqe *cqe;
+  struct uring_op *op;
+
+  while( ( head != tail ) && ( num_events < NETWORK_MAX_EVENTS ) &&
+         ( num_accepted < NETWORK_MAX_EVENTS ) ) {
+    cqe = &cqes[head & *cq_mask];
+    op = (struct uring_op *)(unsigned long)cqe->user_data;
+    head++;
+
+    if( !op ) {
+      continue;                                         /* a cancellation */
+    }
+    switch( op->type ) {
+      case OP_ACCEPT: complete_accept( op, cqe->res ); break;
+      case OP_RECV:   complete_recv( op, cqe->res ); break;
+      case OP_READ:
+      case OP_WRITE:  complete_xfer( op, cqe->res ); break;
+    }
+  }
+  __atomic_store_n( cq_head, head, __ATOMIC_RELEASE );
+}
+
+
+extern int uring_poll( int timeout ) {
+  if( ( next_event < num_events ) || ( next_accepted < num_accepted ) ) {
+    return ( num_events - next_event ) + ( num_accepted - next_accepted );
+  }
+
+  num_events = next_event = 0;
+  num_accepted = next_accepted = 0;
+  reap();                                               /* already done? */
+  if( !num_events && !num_accepted ) {
+    if( submit( timeout ) ) {
+      perror( "Error occurred while waiting" );
+      abort();
+    }
+    reap();
+  } else if( sq_local != *sq_tail ) {
+    submit( 0 );                                        /* just submit */
+  }
+  return num_events + num_accepted;
+}
+
+
+extern int uring_open() {
+  if( next_accepted == num_accepted ) {
+    return -1;
+  }
+  return accepted[next_accepted++];
+}
+
+
+extern int uring_next( int *ev ) {
+  while( next_event < num_events ) {
+    struct uring_event *e = &events[next_event++];
+
+    if( e->fd >= 0 ) {
+      *ev = e->events;
+      return e->fd;
+    }
+  }
+  return -1;
+}
+
+
+extern void uring_close( int fd ) {
+  struct uring_conn *c = get_conn( fd );
+  int i;
+
+  for( i = next_event; i < num_events; i++ ) {          /* drop stale events */
+    if( events[i].fd == fd ) {
+      events[i].fd = -1;
+    }
+  }
+
+  if( c->reading && c->rx->busy ) {                     /* stop pending I/O */
+    submit_cancel( &c->rx->op );
+  }
+  c->reading = 0;
+  if( c->xfer >= 0 ) {
+    submit_cancel( &xfers[c->xfer].read_op );
+    submit_cancel( &xfers[c->xfer].write_op );
+    c->xfer = -1;
+  }
+  c->data = NULL;                                       /* in c->rx */
+  c->gen++;                                             /* orphan the rest */
+
+  if( c->fixed ) {
+    register_file( fd, -1 );
+    c->fixed = 0;
+  }
+  close( fd );
+}
+
+
+extern int uring_read( int fd, char *buf, int len ) {
+  struct uring_conn *c = get_conn( fd );
+  int n;
+
+  if( c->data ) {                                       /* hand out data */
+    n = c->data_len - c->data_off;
+    if( n > len ) {
+      n = len;
+    }
+    memcpy( buf, c->data + c->data_off, n );
+    c->data_off += n;
+    if( c->data_off == c->data_len ) {
+      c->data = NULL;                                   /* rx can be reused */
+    }
+    return n;
+  }
+
+  if( c->eof ) {
+    return 0;
+  } else if( c->err ) {
+    errno = c->err;
+    return -1;
+  }
+
+  if( !c->reading ) {                                   /* ask for more */
+    submit_recv( fd );
+  }
+  errno = EAGAIN;
+  return -1;
+}
+
+
+/* This function takes a free transfer slot for a client socket.
+ * Returns: The slot number, or -1 if the client already has a transfer in
+ *          flight (errno EALREADY) or all the buffers are in use (EBUSY)
+ */
+static int take_xfer( int fd, int len ) {
+  struct uring_conn *c = get_conn( fd );
+  struct uring_xfer *x;
+  int slot;
+
+  if( c->xfer >= 0 ) {                                  /* one at a time */
+    errno = EALREADY;
+    return -1;
+  } else if( !num_free_xfers ) {                        /* all buffers busy */
+    errno = EBUSY;
+    return -1;
+  }
+
+  slot = free_xfers[--num_free_xfers];
+  x = &xfers[slot];
+  x->busy = 1;
+  x->len = len;
+  x->result = -ECANCELED;
+  x->outstanding = 0;
+  x->read_op.fd = x->write_op.fd = fd;
+  x->read_op.gen = x->write_op.gen = c->gen;
+  c->xfer = slot;
+  return slot;
+}
+
+
+extern int uring_write( int fd, const char *buf, int len ) {
+  int slot;
+
+  if( len > NETWORK_URING_BUFSIZE ) {
+    len = NETWORK_URING_BUFSIZE;
+  }
+  slot = take_xfer( fd, len );
+  if( slot < 0 ) {
+    return -1;
+  }
+  memcpy( xfer_mem + slot * NETWORK_URING_BUFSIZE, buf, len );
+  submit_write( slot, len );
+
+  errno = EINPROGRESS;
+  return -1;
+}
+
+
+extern int uring_send_file( int fd, int file, long offset, int len ) {
+  struct io_uring_sqe *sqe;
+  struct uring_xfer *x;
+  int slot;
+
+  if( len > NETWORK_URING_BUFSIZE ) {
+    len = NETWORK_URING_BUFSIZE;
+  }
+  slot = take_xfer( fd, len );
+  if( slot < 0 ) {
+    return -1;
+  }
+  x = &xfers[slot];
+
+  sqe = get_sqe( 2 );                                   /* read, then write */
+  sqe->opcode = IORING_OP_READ_FIXED;
+  sqe->fd = file;
+  sqe->off = offset;
+  sqe->addr = (unsigned long)( xfer_mem + slot * NETWORK_URING_BUFSIZE );
+  sqe->len = len;
+  sqe->buf_index = slot;
+  sqe->flags = IOSQE_IO_LINK;
+  sqe->user_data = (unsigned long)&x->read_op;
+  x->outstanding++;
+  submit_write( slot, len );
+
+  errno = EINPROGRESS;
+  return -1;
+}
+
+
+extern int uring_sent( int fd ) {
+  struct uring_conn *c = get_conn( fd );
+
+  if( c->sent < 0 ) {
+    errno = -c->sent;
+    return -1;
+  }
+  return c->sent;
+}
+
+
+/* This function checks that the kernel supports every operation we use.
+ * Returns: 1 if it does, 0 if not
+ */
+static int probe_ops() {
+  static const int needed[] = { IORING_OP_ACCEPT, IORING_OP_RECV,
+                                IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED,
+                                IORING_OP_ASYNC_CANCEL };
+  size_t size = sizeof( struct io_uring_probe ) +
+                256 * sizeof( struct io_uring_probe_op );
+  struct io_uring_probe *probe = calloc( 1, size );
+  unsigned i;
+  int ok = 1;
+
+  if( !probe || ( sys_register( IORING_REGISTER_PROBE, probe, 256 ) < 0 ) ) {
+    free( probe );
+    return 0;
+  }
+  for( i = 0; i < sizeof( needed ) / sizeof( needed[0] ); i++ ) {
+    if( ( needed[i] > probe->last_op ) ||
+        !( probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED ) ) {
+      ok = 0;
+    }
+  }
+  free( probe );
+  return ok;
+}
+
+
+/* This function maps the rings shared with the kernel.
+ * Returns: 0 on success, -1 on failure
+ */
+static int map_rings( struct io_uring_params *p ) {
+  size_t sq_size = p->sq_off.array + p->sq_entries * sizeof( unsigned );
+  size_t cq_size = p->cq_off.cqes + p->cq_entries * sizeof( struct io_uring_cqe );
+  char *sq_ptr, *cq_ptr;
+
+  if( !( p->features & IORING_FEAT_SINGLE_MMAP ) ) {
+    return -1;                                          /* too old */
+  }
+  if( cq_size > sq_size ) {
+    sq_size = cq_size;
+  }
+
+  sq_ptr = mmap( NULL, sq_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING );
+  if( sq_ptr == MAP_FAILED ) {
+    return -1;
+  }
+  cq_ptr = sq_ptr;
+
+  sqes = mmap( NULL, p->sq_entries * sizeof( struct io_uring_sqe ),
+               PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+               IORING_OFF_SQES );
+  if( sqes == MAP_FAILED ) {
+    munmap( sq_ptr, sq_size );
+    return -1;
+  }
+
+  sq_head = (unsigned *)( sq_ptr + p->sq_off.head );
+  sq_tail = (unsigned *)( sq_ptr + p->sq_off.tail );
+  sq_mask = (unsigned *)( sq_ptr + p->sq_off.ring_mask );
+  sq_array = (unsigned *)( sq_ptr + p->sq_off.array );
+  sq_entries = p->sq_entries;
+  sq_local = *sq_tail;
+  cq_head = (unsigned *)( cq_ptr + p->cq_off.head );
+  cq_tail = (unsigned *)( cq_ptr + p->cq_off.tail );
+  cq_mask = (unsigned *)( cq_ptr + p->cq_off.ring_mask );
+  cqes = (struct io_uring_cqe *)( cq_ptr + p->cq_off.cqes );
+  return 0;
+}
+
+
+/* This function registers the transfer buffers and an empty fixed file
+ *   table, then adds the listening sockets to it.
+ * Returns: 0 on success, -1 on failure
+ */
+static int register_resources( int *socks, int num ) {
+  struct iovec iov[NETWORK_URING_BUFFERS];
+  int *files;
+  int i;
+
+  xfer_mem = mmap( NULL, (size_t)NETWORK_URING_BUFFERS * NETWORK_URING_BUFSIZE,
+                   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if( xfer_mem == MAP_FAILED ) {
+    xfer_mem = NULL;
+    return -1;
+  }
+  for( i = 0; i < NETWORK_URING_BUFFERS; i++ ) {
+    iov[i].iov_base = xfer_mem + i * NETWORK_URING_BUFSIZE;
+    iov[i].iov_len = NETWORK_URING_BUFSIZE;
+    xfers[i].read_op.type = OP_READ;
+    xfers[i].write_op.type = OP_WRITE;
+    xfers[i].read_op.idx = xfers[i].write_op.idx = i;
+    free_xfers[NETWORK_URING_BUFFERS - 1 - i] = i;      /* hand out 0 first */
+  }
+  num_free_xfers = NETWORK_URING_BUFFERS;
+  if( sys_register( IORING_REGISTER_BUFFERS, iov, NETWORK_URING_BUFFERS ) ) {
+    return -1;
+  }
+
+  files = malloc( NETWORK_URING_FILES * sizeof( int ) );
+  if( !files ) {
+    return -1;
+  }
+  for( i = 0; i < NETWORK_URING_FILES; i++ ) {
+    files[i] = -1;                                      /* sparse table */
+  }
+  for( i = 0; i < num; i++ ) {
+    if( socks[i] < NETWORK_URING_FILES ) {
+      files[socks[i]] = socks[i];
+    }
+  }
+  i = sys_register( IORING_REGISTER_FILES, files, NETWORK_URING_FILES );
+  free( files );
+  return i ? -1 : 0;
+}
+
+
+extern int uring_init( int *socks, int num ) {
+  struct io_uring_params p;
+  int i, j;
+
+  memset( &p, 0, sizeof( p ) );
+  ring_fd = sys_setup( NETWORK_URING_ENTRIES, &p );
+  if( ring_fd < 0 ) {
+    return -1;
+  }
+
+  if( map_rings( &p ) || !probe_ops() || register_resources( socks, num ) ) {
+    close( ring_fd );                                   /* frees the rest */
+    ring_fd = -1;
+    if( xfer_mem ) {
+      munmap( xfer_mem, (size_t)NETWORK_URING_BUFFERS * NETWORK_URING_BUFSIZE );
+      xfer_mem = NULL;
+    }
+    return -1;
+  }
+  ext_arg = ( p.features & IORING_FEAT_EXT_ARG ) != 0;
+
+  serv_socks = socks;
+  num_serv = num;
+  for( i = 0; i < num; i++ ) {                          /* start accepting */
+    for( j = 0; j < NETWORK_URING_ACCEPTS; j++ ) {
+      struct uring_op *op = &accept_ops[i * NETWORK_URING_ACCEPTS + j];
+
+      op->type = OP_ACCEPT;
+      op->idx = i;
+      submit_accept( op );
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,35 @@
+/*
+ * File: network_uring.h
+ * Purpose: This file contains the io_uring backend of the network module.
+ *          It is only used by network.c; see network.h for documentation on
+ *          how the network module behaves when the backend is in use.
+ */
+
+#ifndef NETWORK_URING_H
+#define NETWORK_URING_H
+
+/* This function sets up the ring, registers the listening sockets as fixed
+ *   files and the transfer buffers, and submits the first accepts.
+ * Parameters:
+ *             socks : the listening sockets
+ *             num : the number of listening sockets
+ * Returns: 0 on success, -1 if io_uring is not usable on this kernel (the
+ *          caller should then fall back to epoll).
+ */
+extern int uring_init( int *socks, int num );
+
+
+/* These functions implement network_poll(), network_open(), network_next(),
+ *   network_close(), network_read(), network_write(), network_send_file()
+ *   and network_sent() for the io_uring backend.
+ */
+extern int uring_poll( int timeout );
+extern int uring_open();
+extern int uring_next( int *events );
+extern void uring_close( int fd );
+extern int uring_read( int fd, char *buf, int len );
+extern int uring_write( int fd, const char *buf, int len );
+extern int uring_send_file( int fd, int file, long offset, int len );
+extern int uring_sent( int fd );
+
+#endif
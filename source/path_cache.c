@@ -0,0 +1,372 @@
+#define _XOPEN_SOURCE 700 //for nftw
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include "path_cache.h"
+
+// What the watches report: anything that can change what a name in the directory resolves to
+#define WATCH_MASK (IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+	IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW)
+
+#define PATH_CACHE_MIN 256       // starting number of buckets, always a power of 2
+#define PATH_CACHE_MAX 65536     // resolved files kept at most, so random 404s can't grow it forever
+#define WALK_FDS 16              // directories nftw may hold open at once
+
+
+// One of these for every path looked up, and for every watched directory
+struct path_entry {
+	struct path_entry* next;  // in the same bucket
+	char* path;               // relative to the root, "" for the root itself
+	unsigned int hash;
+	int watched;              // 1 if this is a directory we have a watch on
+	int resolved;             // 1 if info holds what the path resolved to
+	struct path_info info;
+};
+
+// Chained hash table of the entries, plus the directory of each watch descriptor
+struct path_cache {
+	int fd;                      // inotify descriptor, -1 if not watching
+	char* root;
+	struct path_entry** buckets;
+	int capacity;
+	int count;                   // all entries
+	int resolved;                // entries with info, bounded by PATH_CACHE_MAX
+	struct path_entry** dirs;    // indexed by watch descriptor, NULL if not ours (any more)
+	int num_dirs;
+};
+
+static struct path_cache pc = { -1 };
+
+
+/* HASH TABLE */
+
+
+static unsigned int hash_path(const char* path)
+{
+	unsigned int h = 2166136261u; //FNV-1a
+	while(*path)
+	{
+		h ^= (unsigned char) *path++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// Returns the link pointing at the entry for path, or at the NULL ending its bucket
+static struct path_entry** entry_slot(const char* path, unsigned int hash)
+{
+	struct path_entry** link = &pc.buckets[hash & (pc.capacity-1)];
+	while(*link && ((*link)->hash != hash || strcmp((*link)->path,path) != 0))
+	{
+		link = &(*link)->next;
+	}
+	return link;
+}
+
+static int table_grow()
+{
+	int capacity = pc.capacity ? pc.capacity*2 : PATH_CACHE_MIN;
+	struct path_entry** buckets = calloc(capacity,sizeof(struct path_entry*));
+	if(!buckets) return 0;
+
+	for(int i = 0; i < pc.capacity; i++)
+	{
+		struct path_entry* e = pc.buckets[i];
+		while(e)
+		{
+			struct path_entry* next = e->next;
+			e->next = buckets[e->hash & (capacity-1)];
+			buckets[e->hash & (capacity-1)] = e;
+			e = next;
+		}
+	}
+	free(pc.buckets);
+	pc.buckets = buckets;
+	pc.capacity = capacity;
+	return 1;
+}
+
+static struct path_entry* add_entry(const char* path, unsigned int hash)
+{
+	if(pc.count >= pc.capacity && !table_grow()) return NULL;
+
+	struct path_entry* e = calloc(1,sizeof(struct path_entry));
+	if(!e) return NULL;
+	e->path = strdup(path);
+	if(!e->path)
+	{
+		free(e);
+		return NULL;
+	}
+	e->hash = hash;
+	e->next = pc.buckets[hash & (pc.capacity-1)];
+	pc.buckets[hash & (pc.capacity-1)] = e;
+	pc.count++;
+	return e;
+}
+
+// Drops what the entry at link resolved to; the entry itself stays if it is a watched directory
+static void forget_entry(struct path_entry** link)
+{
+	struct path_entry* e = *link;
+	if(e->resolved) pc.resolved--;
+	e->resolved = 0;
+	if(e->watched) return;
+
+	*link = e->next;
+	pc.count--;
+	free(e->path);
+	free(e);
+}
+
+// Drops every resolved path, keeping the watched directories if keep_dirs is 1
+static void forget_all(int keep_dirs)
+{
+	for(int i = 0; i < pc.capacity; i++)
+	{
+		struct path_entry** link = &pc.buckets[i];
+		while(*link)
+		{
+			if(!keep_dirs) (*link)->watched = 0;
+			struct path_entry* e = *link;
+			forget_entry(link);
+			if(*link == e) link = &e->next; //kept
+		}
+	}
+}
+
+
+/* WATCHES */
+
+
+static int set_dir(int wd, struct path_entry* dir)
+{
+	if(wd >= pc.num_dirs)
+	{
+		int num = pc.num_dirs ? pc.num_dirs : 64;
+		while(num <= wd) num *= 2;
+		struct path_entry** temp = realloc(pc.dirs,num*sizeof(struct path_entry*));
+		if(!temp) return 0;
+		memset(temp+pc.num_dirs,0,(num-pc.num_dirs)*sizeof(struct path_entry*));
+		pc.dirs = temp;
+		pc.num_dirs = num;
+	}
+	pc.dirs[wd] = dir;
+	return 1;
+}
+
+// Returns the entry of the directory holding path if it is watched, else NULL.
+// Paths with empty, . or .. components are never cached: they would have to be
+// found again from the name in an event.
+static struct path_entry* watched_parent(const char* path)
+{
+	char parent[PATH_MAX];
+	const char* last = path; //start of the last component
+
+	for(const char* p = path; ; p++)
+	{
+		if(*p == '/' || *p == '\0')
+		{
+			int len = p-last;
+			if(len == 0 || (len == 1 && last[0] == '.') || (len == 2 && last[0] == '.' && last[1] == '.'))
+			{
+				return NULL;
+			}
+			if(*p == '\0') break;
+			last = p+1;
+		}
+	}
+
+	int len = last == path ? 0 : last-path-1;
+	if(len >= PATH_MAX) return NULL;
+	memcpy(parent,path,len);
+	parent[len] = '\0';
+
+	struct path_entry* dir = *entry_slot(parent,hash_path(parent));
+	return dir && dir->watched ? dir : NULL;
+}
+
+// nftw callback: watch each directory whose parent is watched, so that a
+// directory is never renamed behind our back
+static int watch_dir(const char* fpath, const struct stat* sb, int typeflag, struct FTW* ftwbuf)
+{
+	if(typeflag != FTW_D) return 0;
+
+	const char* path = ftwbuf->level == 0 ? "" : fpath+strlen(pc.root)+1;
+	if(ftwbuf->level > 0 && !watched_parent(path)) return 0;
+
+	int wd = inotify_add_watch(pc.fd,fpath,WATCH_MASK);
+	if(wd < 0) return 0; //out of watches, say; its files just aren't cached
+
+	unsigned int hash = hash_path(path);
+	struct path_entry* dir = *entry_slot(path,hash);
+	if(!dir) dir = add_entry(path,hash);
+	if(!dir || !set_dir(wd,dir))
+	{
+		inotify_rm_watch(pc.fd,wd);
+		return 0;
+	}
+	dir->watched = 1;
+	return 0;
+}
+
+// Starts over: drops everything and watches the tree as it is now
+static void rewatch()
+{
+	for(int wd = 0; wd < pc.num_dirs; wd++)
+	{
+		if(pc.dirs[wd]) inotify_rm_watch(pc.fd,wd); //its IN_IGNORED is skipped below
+		pc.dirs[wd] = NULL;
+	}
+	forget_all(0);
+	nftw(pc.root,watch_dir,WALK_FDS,FTW_PHYS);
+}
+
+
+/* Upper Level Functions */
+
+
+int path_cache_init(const char* root)
+{
+	pc.root = strdup(root);
+	if(!pc.root) return -1;
+	if(!table_grow())
+	{
+		path_cache_destroy();
+		return -1;
+	}
+
+	pc.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(pc.fd < 0)
+	{
+		path_cache_destroy();
+		return -1;
+	}
+	nftw(pc.root,watch_dir,WALK_FDS,FTW_PHYS);
+	return pc.fd;
+}
+
+// Asks the file system. Sets *cacheable to 0 if the answer can't be kept, because the
+// path is a symbolic link (changes to the target are reported under another name) or
+// the lookup failed for some reason other than the file not being there.
+static int resolve(const char* path, struct path_info* info, int* cacheable)
+{
+	struct stat st;
+	memset(info,0,sizeof(struct path_info));
+	*cacheable = 1;
+
+	if(lstat(path,&st) != 0)
+	{
+		*cacheable = errno == ENOENT;
+		return 0;
+	}
+	if(S_ISLNK(st.st_mode))
+	{
+		*cacheable = 0;
+		if(stat(path,&st) != 0) return 0;
+	}
+	if(!S_ISREG(st.st_mode) || st.st_size > INT_MAX) return 0; //sizes are ints everywhere
+
+	info->exists = 1;
+	info->device = st.st_dev;
+	info->inode = st.st_ino;
+	info->size = st.st_size;
+	info->mtime = st.st_mtim;
+	return 1;
+}
+
+int path_cache_lookup(const char* path, struct path_info* info)
+{
+	int cacheable;
+	if(pc.fd < 0) return resolve(path,info,&cacheable);
+
+	unsigned int hash = hash_path(path);
+	struct path_entry* e = *entry_slot(path,hash);
+	if(e && e->resolved)
+	{
+		*info = e->info;
+		return info->exists;
+	}
+
+	resolve(path,info,&cacheable);
+	if(cacheable && watched_parent(path))
+	{
+		if(pc.resolved >= PATH_CACHE_MAX)
+		{
+			forget_all(1);
+			e = NULL;
+		}
+		if(!e) e = add_entry(path,hash);
+		if(e)
+		{
+			e->info = *info;
+			e->resolved = 1;
+			pc.resolved++;
+		}
+	}
+	return info->exists;
+}
+
+void path_cache_forget(const char* path)
+{
+	if(pc.fd < 0) return;
+
+	struct path_entry** link = entry_slot(path,hash_path(path));
+	if(*link) forget_entry(link);
+}
+
+void path_cache_events()
+{
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	char path[PATH_MAX];
+	int again = 0;
+	ssize_t n;
+
+	if(pc.fd < 0) return;
+	while((n = read(pc.fd,buf,sizeof(buf))) > 0)
+	{
+		const struct inotify_event* ev;
+		for(char* p = buf; p < buf+n; p += sizeof(struct inotify_event)+ev->len)
+		{
+			ev = (const struct inotify_event*) p;
+			if(ev->mask & IN_Q_OVERFLOW)
+			{
+				again = 1; //events were lost
+				continue;
+			}
+			struct path_entry* dir = ev->wd >= 0 && ev->wd < pc.num_dirs ? pc.dirs[ev->wd] : NULL;
+			if(!dir) continue; //a watch we already dropped
+
+			//Directories coming and going move whole subtrees, so start over
+			if(ev->mask & (IN_ISDIR | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED | IN_UNMOUNT))
+			{
+				again = 1;
+				continue;
+			}
+			if(ev->len == 0) continue;
+
+			int len = snprintf(path,sizeof(path),"%s%s%s",dir->path,dir->path[0] ? "/" : "",ev->name);
+			if(len >= (int) sizeof(path)) continue; //too long to have been cached
+			struct path_entry** link = entry_slot(path,hash_path(path));
+			if(*link) forget_entry(link);
+		}
+	}
+	if(again) rewatch();
+}
+
+void path_cache_destroy()
+{
+	if(pc.fd >= 0) close(pc.fd); //drops the watches too
+	forget_all(0);
+	free(pc.buckets);
+	free(pc.dirs);
+	free(pc.root);
+	memset(&pc,0,sizeof(pc));
+	pc.fd = -1;
+}
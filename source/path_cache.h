@@ -0,0 +1,42 @@
+#ifndef CACHE_PATH_CACHE_H_
+#define CACHE_PATH_CACHE_H_
+
+#include <sys/types.h>
+#include <time.h>
+
+/* This remembers what the paths passed to cache.c resolved to, so a hot
+ * request is answered without a stat() or open().  Missing files are
+ * remembered too, so repeated 404s cost nothing either.  Entries are only
+ * kept for paths in a directory that is watched with inotify, and they are
+ * dropped as soon as the watch reports that the file changed.  It is not
+ * thread safe; cache.c calls it while holding its lock. */
+
+/* What a path resolved to */
+struct path_info {
+	int exists;             // 1 for a regular file, 0 if missing or anything else
+	dev_t device;
+	ino_t inode;
+	int size;
+	struct timespec mtime;  // with size, tells if a cached copy is out of date
+};
+
+/* Watch every directory under root (which must be the working directory,
+ * as the paths looked up are relative to it).  Returns the inotify
+ * descriptor, which is non-blocking, or -1 if inotify is not available.
+ * Without it every lookup is a stat(). */
+int path_cache_init( const char* root );
+
+/* Fill in info for path.  Returns info->exists. */
+int path_cache_lookup( const char* path, struct path_info* info );
+
+/* Forget what path resolved to, when the file turned out to have changed
+ * before its event was read. */
+void path_cache_forget( const char* path );
+
+/* Read the pending inotify events and forget the paths that changed. */
+void path_cache_events();
+
+/* Forget everything and stop watching */
+void path_cache_destroy();
+
+#endif /* CACHE_PATH_CACHE_H_ */
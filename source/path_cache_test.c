@@ -0,0 +1,78 @@
+
+#include "path_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+void write_file( const char* path, const char* mode, const char* text ) {
+  FILE* f = fopen( path, mode );
+  assert( f );
+  fputs( text, f );
+  fclose( f );
+}
+
+int main() {
+
+  char dir[] = "/tmp/path_cache_testXXXXXX";
+  struct path_info info;
+
+  /* A small tree, served from the working directory like sws does */
+  assert( mkdtemp( dir ) && chdir( dir ) == 0 );
+  write_file( "a.txt", "w", "hello" );
+  assert( mkdir( "sub", 0700 ) == 0 );
+  write_file( "sub/b.txt", "w", "b" );
+  assert( path_cache_init( "." ) >= 0 );
+
+  assert( path_cache_lookup( "a.txt", &info ) && info.size == 5 );
+  assert( path_cache_lookup( "sub/b.txt", &info ) && info.size == 1 );
+  assert( !path_cache_lookup( "sub", &info ));       /* not a regular file */
+  assert( !path_cache_lookup( "missing.txt", &info ));
+
+  /* Answers come from memory until the change has been read */
+  write_file( "missing.txt", "w", "here now" );
+  assert( !path_cache_lookup( "missing.txt", &info ));
+  path_cache_events();
+  assert( path_cache_lookup( "missing.txt", &info ) && info.size == 8 );
+
+  /* Edited in place: same inode, new size */
+  write_file( "a.txt", "a", " world" );
+  path_cache_events();
+  assert( path_cache_lookup( "a.txt", &info ) && info.size == 11 );
+
+  /* Forgotten before the event is read */
+  write_file( "a.txt", "w", "hi" );
+  assert( path_cache_lookup( "a.txt", &info ) && info.size == 11 );
+  path_cache_forget( "a.txt" );
+  assert( path_cache_lookup( "a.txt", &info ) && info.size == 2 );
+  path_cache_events();
+
+  /* A new directory is watched too */
+  assert( mkdir( "new", 0700 ) == 0 );
+  write_file( "new/c.txt", "w", "c" );
+  path_cache_events();
+  assert( path_cache_lookup( "new/c.txt", &info ) && info.size == 1 );
+  write_file( "new/c.txt", "w", "cc" );
+  path_cache_events();
+  assert( path_cache_lookup( "new/c.txt", &info ) && info.size == 2 );
+
+  /* Removed */
+  assert( unlink( "a.txt" ) == 0 );
+  path_cache_events();
+  assert( !path_cache_lookup( "a.txt", &info ));
+
+  /* Paths that can't be matched to events still resolve, every time */
+  assert( path_cache_lookup( "./sub/../sub/b.txt", &info ) && info.size == 1 );
+
+  path_cache_destroy();
+  unlink( "missing.txt" );
+  unlink( "sub/b.txt" );
+  unlink( "new/c.txt" );
+  rmdir( "sub" );
+  rmdir( "new" );
+  assert( chdir( "/" ) == 0 && rmdir( dir ) == 0 );
+  return EXIT_SUCCESS;
+
+}
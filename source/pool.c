@@ -0,0 +1,260 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include <pthread.h>
+#include "pool.h"
+
+#define POOL_BATCH 32     // free objects moved between a thread and the pool at once
+#define POOL_SLAB_MIN 64  // objects in the smallest slab; each new slab doubles the capacity
+
+#define ALIGN_UP(n) (((n) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1))
+
+
+// A free object holds the link to the next one
+struct free_object {
+	struct free_object* next;
+};
+
+// The free objects one thread keeps for one pool
+struct thread_cache {
+	struct pool* pool;
+	struct free_object* head;
+	int count;
+	struct thread_cache* next;  // in the pool's list of caches
+};
+
+// The objects follow the header
+struct slab {
+	struct slab* next;
+};
+
+#define SLAB_HEADER ALIGN_UP(sizeof(struct slab))
+
+struct pool {
+	const char* name;
+	size_t size;                 // rounded up so that every object is aligned
+	pthread_mutex_t mu;          // covers the fields below except the counts
+	struct free_object* free;    // shared by all the threads
+	struct slab* slabs;
+	struct thread_cache* caches;
+	pthread_key_t key;           // the calling thread's cache
+	long capacity;
+	long num_slabs;
+	long in_use;                 // changed atomically
+	long peak;
+	struct pool* next;           // in the list of all pools
+};
+
+static pthread_mutex_t pools_mu = PTHREAD_MUTEX_INITIALIZER;
+static struct pool* pools;
+
+
+/* SLABS */
+
+
+// Called with the lock held. Returns 1 if successful, 0 if out of memory
+static int add_slab(struct pool* p, long count)
+{
+	struct slab* slab = malloc(SLAB_HEADER + count*p->size);
+	if(!slab) return 0;
+
+	slab->next = p->slabs;
+	p->slabs = slab;
+	p->num_slabs++;
+	p->capacity += count;
+
+	char* objects = (char*)slab + SLAB_HEADER;
+	for(long i = count-1; i >= 0; i--) //first object first
+	{
+		struct free_object* o = (struct free_object*)(objects + i*p->size);
+		o->next = p->free;
+		p->free = o;
+	}
+	return 1;
+}
+
+// Moves up to count objects from the list at from to the front of the list at to
+static int move_objects(struct free_object** from, struct free_object** to, int count)
+{
+	int moved = 0;
+	while(*from && moved < count)
+	{
+		struct free_object* o = *from;
+		*from = o->next;
+		o->next = *to;
+		*to = o;
+		moved++;
+	}
+	return moved;
+}
+
+
+/* THREAD CACHES */
+
+
+// Gives the objects of a thread that exits back to the pool
+static void cache_dtor(void* v)
+{
+	struct thread_cache* c = v;
+	struct pool* p = c->pool;
+
+	pthread_mutex_lock(&p->mu);
+	move_objects(&c->head,&p->free,c->count);
+	struct thread_cache** link = &p->caches;
+	while(*link != c) link = &(*link)->next;
+	*link = c->next;
+	pthread_mutex_unlock(&p->mu);
+	free(c);
+}
+
+static struct thread_cache* thread_cache(struct pool* p)
+{
+	struct thread_cache* c = pthread_getspecific(p->key);
+	if(c) return c;
+
+	c = calloc(1,sizeof(struct thread_cache));
+	if(!c) return NULL;
+	c->pool = p;
+	if(pthread_setspecific(p->key,c) != 0)
+	{
+		free(c);
+		return NULL;
+	}
+	pthread_mutex_lock(&p->mu);
+	c->next = p->caches;
+	p->caches = c;
+	pthread_mutex_unlock(&p->mu);
+	return c;
+}
+
+
+/* Upper Level Functions */
+
+
+struct pool* pool_create(const char* name, size_t size, int prealloc)
+{
+	struct pool* p = calloc(1,sizeof(struct pool));
+	if(!p) return NULL;
+
+	p->name = name;
+	p->size = ALIGN_UP(size < sizeof(struct free_object) ? sizeof(struct free_object) : size);
+	pthread_mutex_init(&p->mu,NULL);
+	if(pthread_key_create(&p->key,cache_dtor) != 0)
+	{
+		free(p);
+		return NULL;
+	}
+	if(prealloc > 0 && !add_slab(p,prealloc))
+	{
+		pthread_key_delete(p->key);
+		free(p);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&pools_mu);
+	p->next = pools;
+	pools = p;
+	pthread_mutex_unlock(&pools_mu);
+	return p;
+}
+
+void* pool_alloc(struct pool* p)
+{
+	struct thread_cache* c = thread_cache(p);
+	if(!c) return NULL;
+
+	if(!c->head)
+	{
+		pthread_mutex_lock(&p->mu);
+		if(!p->free) add_slab(p,p->capacity > POOL_SLAB_MIN ? p->capacity : POOL_SLAB_MIN);
+		c->count += move_objects(&p->free,&c->head,POOL_BATCH);
+		pthread_mutex_unlock(&p->mu);
+		if(!c->head) return NULL;
+	}
+	struct free_object* o = c->head;
+	c->head = o->next;
+	c->count--;
+
+	long in_use = __atomic_add_fetch(&p->in_use,1,__ATOMIC_RELAXED);
+	long peak = __atomic_load_n(&p->peak,__ATOMIC_RELAXED);
+	while(in_use > peak && !__atomic_compare_exchange_n(&p->peak,&peak,in_use,1,__ATOMIC_RELAXED,__ATOMIC_RELAXED));
+	return o;
+}
+
+void pool_free(struct pool* p, void* object)
+{
+	if(!object) return;
+	__atomic_sub_fetch(&p->in_use,1,__ATOMIC_RELAXED);
+
+	struct free_object* o = object;
+	struct thread_cache* c = thread_cache(p);
+	if(!c) //can't keep it, so give it straight back
+	{
+		pthread_mutex_lock(&p->mu);
+		o->next = p->free;
+		p->free = o;
+		pthread_mutex_unlock(&p->mu);
+		return;
+	}
+
+	o->next = c->head;
+	c->head = o;
+	c->count++;
+	if(c->count > 2*POOL_BATCH) //a thread that frees what others allocate passes them on
+	{
+		pthread_mutex_lock(&p->mu);
+		c->count -= move_objects(&c->head,&p->free,POOL_BATCH);
+		pthread_mutex_unlock(&p->mu);
+	}
+}
+
+void pool_get_stats(struct pool* p, struct pool_stats* stats)
+{
+	pthread_mutex_lock(&p->mu);
+	stats->capacity = p->capacity;
+	stats->slabs = p->num_slabs;
+	pthread_mutex_unlock(&p->mu);
+	stats->in_use = __atomic_load_n(&p->in_use,__ATOMIC_RELAXED);
+	stats->peak = __atomic_load_n(&p->peak,__ATOMIC_RELAXED);
+}
+
+void pool_report(FILE* out)
+{
+	struct pool_stats stats;
+
+	pthread_mutex_lock(&pools_mu);
+	for(struct pool* p = pools; p; p = p->next)
+	{
+		pool_get_stats(p,&stats);
+		fprintf(out,"Pool %s: %ld of %ld in use, peak %ld, %ld slabs of %zu-byte objects\n",
+		        p->name,stats.in_use,stats.capacity,stats.peak,stats.slabs,p->size);
+	}
+	pthread_mutex_unlock(&pools_mu);
+}
+
+void pool_destroy(struct pool* p)
+{
+	if(!p) return;
+
+	pthread_mutex_lock(&pools_mu);
+	struct pool** link = &pools;
+	while(*link != p) link = &(*link)->next;
+	*link = p->next;
+	pthread_mutex_unlock(&pools_mu);
+
+	pthread_key_delete(p->key); //the caches' destructors won't run any more
+	while(p->caches)
+	{
+		struct thread_cache* c = p->caches;
+		p->caches = c->next;
+		free(c);
+	}
+	while(p->slabs)
+	{
+		struct slab* slab = p->slabs;
+		p->slabs = slab->next;
+		free(slab);
+	}
+	pthread_mutex_destroy(&p->mu);
+	free(p);
+}
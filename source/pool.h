@@ -0,0 +1,39 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Fixed-size object pools, for the objects that are allocated and freed
+ * for every request.  Objects are carved from slabs, which go back to the
+ * system only when the pool is destroyed.  Each thread keeps a few free
+ * objects of its own, so the pool's lock is only taken to move a batch of
+ * them between a thread and the pool.  An object may be freed by another
+ * thread than the one that allocated it. */
+struct pool;
+
+struct pool_stats {
+	long capacity;  // objects in the slabs
+	long in_use;    // allocated and not yet freed
+	long peak;      // the most that were ever in use at once
+	long slabs;
+};
+
+/* Creates a pool of objects of size bytes, with the first prealloc of
+ * them allocated up front.  name is only used for reports.  Returns NULL
+ * if out of memory. */
+struct pool* pool_create( const char* name, size_t size, int prealloc );
+
+/* Returns an object, not zeroed, or NULL if out of memory. */
+void* pool_alloc( struct pool* );
+void pool_free( struct pool*, void* );
+
+void pool_get_stats( struct pool*, struct pool_stats* );
+
+/* Prints the occupancy of every pool there is. */
+void pool_report( FILE* out );
+
+/* Frees the slabs, with any objects still in use. */
+void pool_destroy( struct pool* );
+
+#endif /* POOL_H_ */
@@ -0,0 +1,61 @@
+
+#include "pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <assert.h>
+
+#define COUNT 1000
+
+struct pool* p;
+void* objects[COUNT];
+
+void* free_all( void* arg ) {
+  for( int i = 0; i < COUNT; ++i ) {
+    pool_free( p, objects[i] );
+  }
+  return NULL;
+}
+
+int main() {
+
+  struct pool_stats stats;
+  pthread_t thread;
+
+  p = pool_create( "test", 24, 8 );
+  assert( p );
+  pool_get_stats( p, &stats );
+  assert( stats.capacity == 8 && stats.in_use == 0 && stats.slabs == 1 );
+
+  /* Grows past what was allocated up front; objects are aligned and distinct */
+  for( int i = 0; i < COUNT; ++i ) {
+    objects[i] = pool_alloc( p );
+    assert( objects[i] && (uintptr_t) objects[i] % 16 == 0 );
+    memset( objects[i], i & 0xff, 24 );
+  }
+  for( int i = 0; i < COUNT; ++i ) {
+    assert( ((unsigned char*) objects[i])[23] == ( i & 0xff ));
+  }
+  pool_get_stats( p, &stats );
+  assert( stats.in_use == COUNT && stats.peak == COUNT && stats.capacity >= COUNT );
+
+  /* Freed by another thread, and allocated again here without growing */
+  assert( pthread_create( &thread, NULL, free_all, NULL ) == 0 );
+  assert( pthread_join( thread, NULL ) == 0 );
+  pool_get_stats( p, &stats );
+  assert( stats.in_use == 0 && stats.peak == COUNT );
+  long capacity = stats.capacity;
+  for( int i = 0; i < COUNT; ++i ) {
+    objects[i] = pool_alloc( p );
+    assert( objects[i] );
+  }
+  pool_get_stats( p, &stats );
+  assert( stats.capacity == capacity );
+
+  pool_report( stdout );
+  pool_destroy( p );
+  return EXIT_SUCCESS;
+
+}
@@ -1,14 +1,29 @@
 #ifndef RCB_H
 #define RCB_H
 
+struct Scheduler;
+struct request_times;
 
 struct RequestControlBlock {
 	struct RequestControlBlock *next;	/*The next rcb in the queue*/
 	int sequenceNumber;
 	int fileDescriptor;
-	FILE* fileHandle;
+	int cacheDescriptor;		/*Cache descriptor of the file, -1 if none*/
+	const char *cachedData;		/*Contents of the file if it is cached*/
+	int file;			/*Open file if it is not cached, else -1*/
 	int lengthRemaining;
+	int offset;			/*Bytes of the file already sent*/
 	int quantum;
+	int level;			/*MLFB queue of the rcb, 0 for high priority*/
+	long long priority;		/*Place in the SJF and SRPT heap, lowest first*/
+	long long arrival;		/*Bytes scheduled before it arrived, for SRPT aging*/
+	struct Scheduler *scheduler;	/*The scheduler whose queues hold the rcb*/
+	struct Scheduler *payer;	/*The scheduler it was last taken from, which charges its quantum*/
+	unsigned int client;		/*Address of the client, for fair scheduling*/
+	const char *header;		/*Response header, sent before the file*/
+	int headerLength;
+	int headerSent;			/*Bytes of the header already sent*/
+	struct request_times *times;	/*Phases of the request, timed by the server, or NULL*/
 }; 
 
 #endif
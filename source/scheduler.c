@@ -5,105 +5,514 @@
 #include <unistd.h>
 
 #include "scheduler.h"
+#include "cache.h"
+#include "pool.h"
 
 
 int globalSequence = 0;			  		/* sequence number of next RCB */
-//struct RequestControlBlock queue[RCB_QUEUE_SIZE];	/* holds all RCBs for the scheduler */
-int queueSize = 0;					/* number of RCBs in queue */
-struct RequestControlBlock *firstRcb = NULL;		/* pointer to the first RCB in the queue */
+static struct pool *rcbPool = NULL;			/* where the RCBs come from */
+static const struct SchedulerOps *ops = NULL;		/* the scheduler type, from setScheduler */
+static int numLevels = 1;				/* queues in use in each scheduler */
+static int quantums[MAX_LEVELS] = { EIGHT_KB };		/* of each level */
+static int aging = SRPT_AGING;				/* percent, with SRPT */
+static long long scheduledBytes = 0;			/* by SRPT, changed atomically */
+static int fairQuantum = 0;				/* bytes per round of each client */
+static struct pool *groupPool = NULL;			/* where the client groups come from */
+static struct {
+	unsigned int client;
+	int weight;
+} clientWeights[MAX_WEIGHTS];				/* of the clients that are not 1 */
+static int numWeights = 0;
+static int queueBound = RCB_QUEUE_SIZE;			/* RCBs with a file in each scheduler */
 
-/*The following two pointers are only used with MLFB scheduler */
-struct RequestControlBlock *firstRcb64 = NULL;	/* pointer to the first RCB in the medium priority queue */
-struct RequestControlBlock *firstRcbRr = NULL; 	/* pointer to the first RCB in the low priority queue */
+extern int initRcbPool(int rcbs){
+	rcbPool = pool_create("rcbs", sizeof(struct RequestControlBlock), rcbs);
+	return rcbPool ? 0 : -1;
+}
+
+extern void initScheduler(struct Scheduler *sched){
+	int i;
+
+	pthread_mutex_init(&sched->lock, NULL);
+	sched->queueSize = 0;
+	sched->sjf.count = 0;
+	sched->sjf.capacity = RCB_QUEUE_SIZE;
+	sched->sjf.rcbs = malloc(RCB_QUEUE_SIZE * sizeof(struct RequestControlBlock *));
+	if (sched->sjf.rcbs == NULL) {
+		perror("Error while allocating memory");
+		abort();
+	}
+	for (i = 0; i < MAX_LEVELS; i++){
+		sched->levels[i].first = sched->levels[i].last = NULL;
+	}
+	for (i = 0; i < CLIENT_BUCKETS; i++){
+		sched->buckets[i] = NULL;
+	}
+	sched->firstGroup = sched->lastGroup = NULL;
+}
 
 /*for testing only*/
-extern void displayQueue(int n){
-	int i = 0;
-	struct RequestControlBlock *rcb  = firstRcb;
-	while(rcb != NULL){
-		printf("%d: %d\n", i, rcb->sequenceNumber);
-		rcb = rcb->next;
-		i++;		
+extern void displayQueue(struct Scheduler *sched, int n){
+	int i, level;
+	struct RequestControlBlock *rcb;
+	struct ClientGroup *group;
+	for (i = 0; (i < n) && (i < sched->sjf.count); i++){	/* in heap order */
+		printf("%d: %d\n", i, sched->sjf.rcbs[i]->sequenceNumber);
+	}
+	for (level = 0; level < numLevels; level++){
+		rcb = sched->levels[level].first;
+		for (i = 0; (i < n) && (rcb != NULL); i++){
+			printf("%d.%d: %d\n", level, i, rcb->sequenceNumber);
+			rcb = rcb->next;
+		}
 	} 
+	for (group = sched->firstGroup; group != NULL; group = group->nextActive){
+		printf("client %08x: %d jobs, %ld bytes of credit\n", group->client, group->jobs, group->deficit);
+	}
 }
 
-/* This function adds an RCB into the queue in order by length remaining, 
- * where the job with the shortest length remaining is at the front of the queue 
+/* This function returns 1 if a should run before b under SJF or SRPT.
  */
-void addRcbSjf(struct RequestControlBlock *rcb){
-	if (firstRcb == NULL) {
-		rcb->next = NULL;
-		firstRcb = rcb;
-		return;
-	}	
-	struct RequestControlBlock *prev;			
-	prev = NULL;
-	rcb->next = firstRcb;
-	while((rcb->next != NULL)){
-		if (rcb->next->lengthRemaining > rcb->lengthRemaining){
-			if (prev == NULL){	/* add rcb to the front of the list */
-				firstRcb = rcb;						
-			}
-			else {
-				prev->next = rcb;
-			}
+static int shorterJob(struct RequestControlBlock *a, struct RequestControlBlock *b){
+	if (a->priority != b->priority){
+		return a->priority < b->priority;
+	}
+	return a->sequenceNumber < b->sequenceNumber;
+}
+
+/* This function adds an RCB into the SJF heap, where the job with the
+ * shortest length remaining is at the top. With SRPT the length is aged
+ * by the bytes sent before the job arrived: as the same number of bytes
+ * is sent while each job in the heap waits, adding them to the ones that
+ * arrived later orders the jobs as taking them off the ones that wait.
+ * The scheduler lock must be held by the caller, as for all the static functions.
+ */
+static void addRcbSjf(struct Scheduler *sched, struct RequestControlBlock *rcb){
+	struct RcbHeap *heap = &sched->sjf;
+	int i = heap->count++;
+
+	rcb->priority = rcb->lengthRemaining + rcb->arrival * aging / 100;
+
+	if (heap->count > heap->capacity){
+		struct RequestControlBlock **rcbs = realloc(heap->rcbs, 2 * heap->capacity * sizeof(struct RequestControlBlock *));
+		if (rcbs == NULL) {
+			perror("Error while allocating memory");
+			abort();
+		}
+		heap->rcbs = rcbs;
+		heap->capacity *= 2;
+	}
+	/* Move parents down until the new job's place is found */
+	while ((i > 0) && shorterJob(rcb, heap->rcbs[(i - 1) / 2])){
+		heap->rcbs[i] = heap->rcbs[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap->rcbs[i] = rcb;
+	rcb->next = NULL;
+}
+
+/* This function removes the shortest job from the SJF heap, or returns
+ * NULL if it is empty.
+ */
+static struct RequestControlBlock* takeRcbSjf(struct Scheduler *sched){
+	struct RcbHeap *heap = &sched->sjf;
+	struct RequestControlBlock *rcb, *last;
+	int i = 0;
+
+	if (heap->count == 0){
+		return NULL;
+	}
+	rcb = heap->rcbs[0];
+	last = heap->rcbs[--heap->count];
+	/* Move the shorter child up until the last job fits in the hole */
+	for (;;){
+		int child = 2 * i + 1;
+		if (child >= heap->count){
+			break;
+		}
+		if ((child + 1 < heap->count) && shorterJob(heap->rcbs[child + 1], heap->rcbs[child])){
+			child++;
+		}
+		if (!shorterJob(heap->rcbs[child], last)){
 			break;
 		}
-		else {			/* move to the next item in the list */
-			prev = rcb->next;
-			rcb->next = rcb->next->next;
-		}				
+		heap->rcbs[i] = heap->rcbs[child];
+		i = child;
 	}
-	if (rcb->next == NULL){		/* add rcb to the end of the list */
-		prev->next = rcb;
+	if (heap->count > 0){
+		heap->rcbs[i] = last;
 	}
+	return rcb;
 }
 
 /* This funciton adds an RCB to the end of a queue. This function
- * takes in a pointer to the first element of the queue in order to support MLFB 
+ * takes in the queue in order to support the levels of MLFB 
  */
-void addRcbToEnd(struct RequestControlBlock *rcb, struct RequestControlBlock *first){
-	if (firstRcb == NULL) {
+static void addRcbToEnd(struct RcbQueue *queue, struct RequestControlBlock *rcb){
+	rcb->next = NULL;
+	if (queue->last == NULL) {
+		queue->first = rcb;
+	}
+	else {
+		queue->last->next = rcb;
+	}
+	queue->last = rcb;
+}
+
+/* This function takes the first RCB off a queue, or returns NULL if it is empty.
+ */
+static struct RequestControlBlock* takeFirst(struct RcbQueue *queue){
+	struct RequestControlBlock *rcb = queue->first;
+	if (rcb != NULL) {
+		queue->first = rcb->next;
+		if (queue->first == NULL) {
+			queue->last = NULL;
+		}
 		rcb->next = NULL;
-		firstRcb = rcb;
-		return;
 	}
+	return rcb;
+}
+
+
+/* SJF: the job with the least left to send runs to completion */
+
+static void enqueueSjf(struct Scheduler *sched, struct RequestControlBlock *rcb){
+	rcb->quantum = rcb->lengthRemaining;
+	rcb->arrival = 0;			/* no aging */
+	addRcbSjf(sched, rcb);
+}
+
+/* All jobs should complete in one pass for SJF, unless the socket blocked */
+static void requeueSjf(struct Scheduler *sched, struct RequestControlBlock *rcb){
+	rcb->quantum = rcb->lengthRemaining;
+	addRcbSjf(sched, rcb);
+}
+
+/* SRPT: SJF that picks the shortest job again after every quantum */
+
+static void enqueueSrpt(struct Scheduler *sched, struct RequestControlBlock *rcb){
+	rcb->quantum = quantums[0];
+	rcb->arrival = __atomic_load_n(&scheduledBytes, __ATOMIC_RELAXED);
+	addRcbSjf(sched, rcb);
+}
+
+/* The clock of the aging is shared by the schedulers of all the workers,
+ * so that a stolen job keeps its age. It goes on by the bytes that were
+ * sent, which may be more or less than the quantum */
+static void chargeSrpt(struct Scheduler *sched, struct RequestControlBlock *rcb, int len){
+	__atomic_add_fetch(&scheduledBytes, len, __ATOMIC_RELAXED);
+}
+
+/* RR and MLFB: RR is MLFB with one level, so the jobs take turns there */
+
+static void enqueueLevels(struct Scheduler *sched, struct RequestControlBlock *rcb){
+	rcb->level = 0;
+	rcb->quantum = quantums[0];
+	addRcbToEnd(&sched->levels[0], rcb);
+}
+
+/* The jobs in a level ahead of the ones in the levels below it */
+static struct RequestControlBlock* dequeueLevels(struct Scheduler *sched){
+	struct RequestControlBlock *rcb = NULL;
+	int level;
+
+	for (level = 0; (rcb == NULL) && (level < numLevels); level++){
+		rcb = takeFirst(&sched->levels[level]);
+	}
+	return rcb;
+}
 
-	struct RequestControlBlock *temp = firstRcb;
-	/* Go through the queue to find the end  */
-	while(temp->next != NULL){
-		temp = temp->next;
+/* Demote to the next level down, or return to the end of the last level */
+static void demote(struct RequestControlBlock *rcb){
+	if (rcb->level < numLevels - 1){
+		rcb->level++;
 	}
-	temp->next = rcb;
-	rcb->next = NULL;
+	rcb->quantum = quantums[rcb->level];
+}
+
+static void requeueLevels(struct Scheduler *sched, struct RequestControlBlock *rcb){
+	demote(rcb);
+	addRcbToEnd(&sched->levels[rcb->level], rcb);
 }
 
-extern int createRCB(int fd, FILE* fh, int sz, char* type){
+static void resumeLevels(struct Scheduler *sched, struct RequestControlBlock *rcb){
+	addRcbToEnd(&sched->levels[rcb->level], rcb);
+}
 
-	if (queueSize <= RCB_QUEUE_SIZE) {
-		struct RequestControlBlock rcb;
-		rcb.sequenceNumber = globalSequence++;
-		rcb.fileDescriptor = fd;
-		rcb.fileHandle = fh;
-		rcb.lengthRemaining = sz;
+/* Fair RR and MLFB: the levels of each client, and deficit round robin
+ * between the clients */
 
-		/* Add RCB to queue */		
-		if(strcmp(type, "SJF") == 0){	/*slot rcb into queue in SJF order */
-			rcb.quantum = sz;
-			addRcbSjf(&rcb);
+static struct ClientGroup** clientBucket(struct Scheduler *sched, unsigned int client){
+	return &sched->buckets[((client * 2654435761u) >> 16) % CLIENT_BUCKETS];
+}
+
+/* This function returns the group of a client, or NULL if the client has
+ * no jobs in the queues.
+ */
+static struct ClientGroup* findGroup(struct Scheduler *sched, unsigned int client){
+	struct ClientGroup *group;
+
+	for (group = *clientBucket(sched, client); group != NULL; group = group->nextInBucket){
+		if (group->client == client){
+			return group;
+		}
+	}
+	return NULL;
+}
+
+/* This function returns the group of a client, and starts a new one at
+ * the end of the round if the client has no jobs in the queues.
+ */
+static struct ClientGroup* clientGroup(struct Scheduler *sched, unsigned int client){
+	struct ClientGroup **bucket = clientBucket(sched, client);
+	struct ClientGroup *group = findGroup(sched, client);
+	int i;
+
+	if (group != NULL){
+		return group;
+	}
+
+	group = pool_alloc(groupPool);
+	if (group == NULL) {
+		perror("Error while allocating memory");
+		abort();
+	}
+	group->client = client;
+	group->weight = 1;
+	for (i = 0; i < numWeights; i++){
+		if (clientWeights[i].client == client){
+			group->weight = clientWeights[i].weight;
+		}
+	}
+	group->deficit = (long)fairQuantum * group->weight;
+	group->jobs = 0;
+	for (i = 0; i < numLevels; i++){
+		group->levels[i].first = group->levels[i].last = NULL;
+	}
+	group->nextInBucket = *bucket;
+	*bucket = group;
+	group->nextActive = NULL;
+	if (sched->lastGroup == NULL) {
+		sched->firstGroup = group;
+	}
+	else {
+		sched->lastGroup->nextActive = group;
+	}
+	sched->lastGroup = group;
+	return group;
+}
+
+static void addRcbToGroup(struct Scheduler *sched, struct RequestControlBlock *rcb){
+	struct ClientGroup *group = clientGroup(sched, rcb->client);
+
+	addRcbToEnd(&group->levels[rcb->level], rcb);
+	group->jobs++;
+}
+
+static void enqueueFair(struct Scheduler *sched, struct RequestControlBlock *rcb){
+	rcb->level = 0;
+	rcb->quantum = quantums[0];
+	addRcbToGroup(sched, rcb);
+}
+
+static void requeueFair(struct Scheduler *sched, struct RequestControlBlock *rcb){
+	demote(rcb);
+	addRcbToGroup(sched, rcb);
+}
+
+/* The group whose turn it is runs its next job if it has the credit for
+ * its quantum, and pays for the bytes the job sent once the quantum is
+ * over. If not, its turn ends, it gets more credit and waits for the next
+ * round. A group that has run all its jobs leaves the round, along with
+ * any credit or debt it had left.
+ */
+static struct RequestControlBlock* dequeueFair(struct Scheduler *sched){
+	struct ClientGroup *group, **link;
+	struct RequestControlBlock *rcb;
+	int level, cost;
+
+	while ((group = sched->firstGroup) != NULL){
+		for (level = 0; group->levels[level].first == NULL; level++);
+		rcb = group->levels[level].first;
+		cost = (rcb->quantum < rcb->lengthRemaining) ? rcb->quantum : rcb->lengthRemaining;
+		if (group->deficit >= cost){
+			takeFirst(&group->levels[level]);
+			if (--group->jobs == 0){
+				sched->firstGroup = group->nextActive;
+				if (sched->firstGroup == NULL) {
+					sched->lastGroup = NULL;
+				}
+				for (link = clientBucket(sched, group->client); *link != group; link = &(*link)->nextInBucket);
+				*link = group->nextInBucket;
+				pool_free(groupPool, group);
+			}
+			return rcb;
+		}
+
+		group->deficit += (long)fairQuantum * group->weight;
+		if (group->nextActive != NULL) {	/* to the end of the round */
+			sched->firstGroup = group->nextActive;
+			group->nextActive = NULL;
+			sched->lastGroup->nextActive = group;
+			sched->lastGroup = group;
 		}
-		/* RR and MLFB handle new RCBs the same way */
-		else if ((strcmp(type, "RR") == 0) || (strcmp(type, "MLFB") == 0)){
-			rcb.quantum = EIGHT_KB;
-			addRcbToEnd(&rcb, firstRcb);
+	}
+	return NULL;
+}
+
+/* The group may have left the round, if the job was its last one */
+static void chargeFair(struct Scheduler *sched, struct RequestControlBlock *rcb, int len){
+	struct ClientGroup *group = findGroup(sched, rcb->client);
+
+	if (group != NULL){
+		group->deficit -= len;
+	}
+}
+
+static const struct SchedulerOps sjfOps = {
+	"SJF", enqueueSjf, takeRcbSjf, requeueSjf, addRcbSjf, NULL
+};
+
+static const struct SchedulerOps srptOps = {
+	"SRPT", enqueueSrpt, takeRcbSjf, addRcbSjf, addRcbSjf, chargeSrpt
+};
+
+static const struct SchedulerOps rrOps = {
+	"RR", enqueueLevels, dequeueLevels, requeueLevels, resumeLevels, NULL
+};
+
+static const struct SchedulerOps mlfbOps = {
+	"MLFB", enqueueLevels, dequeueLevels, requeueLevels, resumeLevels, NULL
+};
+
+static const struct SchedulerOps fairOps = {
+	"fair", enqueueFair, dequeueFair, requeueFair, addRcbToGroup, chargeFair
+};
+
+extern int setScheduler(const char *type, const int *quanta, int levels){
+	static const int defaults[] = { EIGHT_KB, SIXTY_FOUR_KB, SIXTY_FOUR_KB };
+	int i;
+
+	if (quanta == NULL){
+		quanta = defaults;
+		levels = 3;
+	}
+	if ((levels < 1) || (levels > MAX_LEVELS)){
+		return -1;
+	}
+	for (i = 0; i < levels; i++){
+		if (quanta[i] <= 0){
+			return -1;
 		}
-		else {
-			perror("Invalid scheduler type");
+	}
+
+	if (strcmp(type, "SJF") == 0){
+		ops = &sjfOps;
+		levels = 0;			/* the heap is its only queue */
+	}
+	else if (strcmp(type, "SRPT") == 0){
+		ops = &srptOps;
+		levels = 1;			/* only the first quantum */
+	}
+	else if (strcmp(type, "RR") == 0){
+		ops = &rrOps;
+		levels = 1;
+	}
+	else if (strcmp(type, "MLFB") == 0){
+		ops = &mlfbOps;
+	}
+	else {
+		return -1;
+	}
+
+	for (i = 0; i < levels; i++){
+		quantums[i] = quanta[i];
+	}
+	numLevels = levels;
+	return 0;
+}
+
+extern int setAging(int percent){
+	if (percent < 0){
+		return -1;
+	}
+	aging = percent;
+	return 0;
+}
+
+extern int setFairness(int quantum){
+	if ((quantum <= 0) || ((ops != &rrOps) && (ops != &mlfbOps))){
+		return -1;
+	}
+	if (groupPool == NULL){
+		groupPool = pool_create("client groups", sizeof(struct ClientGroup), RCB_QUEUE_SIZE);
+		if (groupPool == NULL){
+			return -1;
+		}
+	}
+	fairQuantum = quantum;
+	ops = &fairOps;
+	return 0;
+}
+
+extern int setClientWeight(unsigned int client, int weight){
+	if ((weight <= 0) || (numWeights == MAX_WEIGHTS)){
+		return -1;
+	}
+	clientWeights[numWeights].client = client;
+	clientWeights[numWeights].weight = weight;
+	numWeights++;
+	return 0;
+}
+
+extern int setQueueBound(int rcbs){
+	if (rcbs < 1){
+		return -1;
+	}
+	queueBound = rcbs;
+	return 0;
+}
+
+extern int createRCB(struct Scheduler *sched, int fd, unsigned int client, int cfd, int sz, const char *header, int headerLength,
+		     struct request_times *times){
+	struct RequestControlBlock *rcb = pool_alloc(rcbPool);
+	if (rcb == NULL) {
+		perror("Error while allocating memory");
+		return 0;
+	}
+	rcb->fileDescriptor = fd;
+	rcb->client = client;
+	rcb->cacheDescriptor = cfd;
+	rcb->cachedData = NULL;
+	rcb->file = -1;
+	if ((cfd >= 0) && (cache_source(cfd, &rcb->cachedData, &rcb->file) != 0)) {
+		pool_free(rcbPool, rcb);
+		return 0;
+	}
+	rcb->lengthRemaining = sz;
+	rcb->offset = 0;
+	rcb->scheduler = sched;
+	rcb->payer = sched;
+	rcb->header = header;
+	rcb->headerLength = headerLength;
+	rcb->headerSent = 0;
+	rcb->times = times;
+
+	pthread_mutex_lock(&sched->lock);
+	if ((cfd < 0) || (sched->queueSize < queueBound)) {
+		rcb->sequenceNumber = globalSequence++;
+
+		/* Add RCB to queue */		
+		rcb->level = 0;
+		ops->enqueue(sched, rcb);
+		if (cfd >= 0) {
+			sched->queueSize++;
 		}
-		
-		queueSize++;
+		pthread_mutex_unlock(&sched->lock);
 		return 1;
 	}
+	pthread_mutex_unlock(&sched->lock);
+	pool_free(rcbPool, rcb);
 	return 0;					//queue was full
 }
 
@@ -113,8 +522,12 @@ void removeRCB(struct RequestControlBlock *rcb){
 		return;
 	}
 	else {
-		queueSize--;
-		free(rcb);
+		if (rcb->cacheDescriptor >= 0) {
+			pthread_mutex_lock(&rcb->scheduler->lock);
+			rcb->scheduler->queueSize--;
+			pthread_mutex_unlock(&rcb->scheduler->lock);
+		}
+		pool_free(rcbPool, rcb);
 	}
 }
 
@@ -122,74 +535,100 @@ void removeRCB(struct RequestControlBlock *rcb){
  * to ensure that there is space for the job to rejoin the queue
  * if it does not complete. 
  */ 
-extern struct RequestControlBlock* getNextJob(char* type){
+extern struct RequestControlBlock* getNextJob(struct Scheduler *sched){
 	struct RequestControlBlock* rcb;
-	/* SJF and RR only have one queue and the next job is at the front */
-	if ((strcmp(type, "SJF") == 0) || (strcmp(type, "RR") == 0)){
-		rcb = firstRcb;	/* Get the first job in the queue */
-		if (rcb != NULL) {		
-			firstRcb = rcb->next; 			/*Remove job from queue */
-		}	
-	}
-	
-	/* MLFB has to consider the possibility that the next job is in a different queue */	
-	else if (strcmp(type, "MLFB") == 0){
-		rcb = NULL;
-		if (firstRcb != NULL) {			/* Try high priority queue first */
-			rcb = firstRcb;			
-			firstRcb = rcb->next;
-		}
-		else if (firstRcb64 != NULL) {		/* Move to medium priority queue */
-			rcb = firstRcb64;
-			firstRcb64 = rcb->next;
+
+	pthread_mutex_lock(&sched->lock);
+	rcb = ops->dequeue(sched);
+	if (rcb != NULL) {
+		rcb->payer = sched;
+	}
+	pthread_mutex_unlock(&sched->lock);
+	return rcb;
+}
+
+extern struct RequestControlBlock* stealJob(struct Scheduler *thief, struct Scheduler *victim){
+	struct RequestControlBlock* rcb;
+
+	pthread_mutex_lock(&victim->lock);
+	rcb = ops->dequeue(victim);
+	if (rcb != NULL) {			/* the victim's credit paid for the quantum */
+		rcb->payer = victim;
+		if (rcb->cacheDescriptor >= 0) {
+			victim->queueSize--;
 		}
-		else if (firstRcbRr != NULL) {		/* Move to low priority queue */
-			rcb = firstRcbRr;
-			firstRcbRr = rcb->next;
+	}
+	pthread_mutex_unlock(&victim->lock);
+
+	if (rcb != NULL) {			/* the thief's queues hold it from now on */
+		pthread_mutex_lock(&thief->lock);
+		if (rcb->cacheDescriptor >= 0) {
+			thief->queueSize++;
 		}
+		rcb->scheduler = thief;
+		pthread_mutex_unlock(&thief->lock);
 	}
+	return rcb;
+}
 
-	else {
-		perror("Invalid scheduler type");
+extern int hasJobs(struct Scheduler *sched){
+	int jobs;
+	int level;
+
+	pthread_mutex_lock(&sched->lock);
+	jobs = (sched->sjf.count > 0) || (sched->firstGroup != NULL);
+	for (level = 0; !jobs && (level < numLevels); level++){
+		jobs = (sched->levels[level].first != NULL);
 	}
+	pthread_mutex_unlock(&sched->lock);
+	return jobs;
+}
 
-	return rcb; 
+/* This function charges a job for the bytes it sent, before it is put
+ * back or removed. A stolen job is charged by the scheduler it was stolen
+ * from, so that its client pays there for the credit it used.
+ */
+static void chargeRCB(int len, struct RequestControlBlock* rcb){
+	struct Scheduler *sched = rcb->payer;
+
+	if ((ops->charge != NULL) && (len > 0)){
+		pthread_mutex_lock(&sched->lock);
+		ops->charge(sched, rcb, len);
+		pthread_mutex_unlock(&sched->lock);
+	}
 }
 
-extern void updateRCB(char* type, int len, struct RequestControlBlock* rcb){
+extern int updateRCB(int len, struct RequestControlBlock* rcb){
+	struct Scheduler *sched = rcb->scheduler;
+
+	chargeRCB(len, rcb);
 	rcb->lengthRemaining -= len;
 	/* Regardless of scheduler type, and finished job is handled the same way */	
 	if (rcb->lengthRemaining <= 0){
-		printf("Request %d completed", rcb->sequenceNumber);
-		fclose(rcb->fileHandle);
-		close(rcb->fileDescriptor);			
-		removeRCB(rcb);
-	}
-	else if (strcmp(type,"SJF") == 0){
-		/* All jobs should complete in one pass for SJF */
-		printf("Something went wrong processing %d with SJF.", rcb->sequenceNumber);
-	}
-	else if (strcmp(type, "RR") == 0){
-		/* Rturn to the end of the queue */
-		addRcbToEnd(rcb, firstRcb);
-	}
-	else if (strcmp(type, "MLFB") == 0){
-		if (rcb->quantum == EIGHT_KB) { 	/* Demote to medium priority queue */
-			rcb->quantum = SIXTY_FOUR_KB;
-			addRcbToEnd(rcb, firstRcb64);			
+		if (rcb->cacheDescriptor >= 0){
+			cache_close(rcb->cacheDescriptor);
 		}
-		else {				/* Put in low priority queue */
-			addRcbToEnd(rcb, firstRcbRr);
-		}
-	}
-	else {
-		perror("Invalid scheduler type");
+		removeRCB(rcb);
+		return 1;
 	}
-}
-
-
-
 
+	pthread_mutex_lock(&sched->lock);
+	ops->requeue(sched, rcb);
+	pthread_mutex_unlock(&sched->lock);
+	return 0;
+}
 
+extern void blockRCB(int len, struct RequestControlBlock* rcb){
+	/* The RCB keeps its slot (queueSize is unchanged) so it can rejoin */
+	chargeRCB(len, rcb);
+	rcb->lengthRemaining -= len;
+	rcb->next = NULL;
+}
 
+extern void resumeRCB(struct RequestControlBlock* rcb){
+	struct Scheduler *sched = rcb->scheduler;
 
+	pthread_mutex_lock(&sched->lock);
+	ops->resume(sched, rcb);
+	pthread_mutex_unlock(&sched->lock);
+}
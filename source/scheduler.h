@@ -2,6 +2,7 @@
 #define SCHEDULER_H
 
 #include <stdio.h>
+#include <pthread.h>
 #include "rcb.h"
 
 
@@ -9,44 +10,197 @@
 #define MAX_HTTP_SIZE 	8192            /* size of buffer to allocate */
 #define EIGHT_KB	8192		/* size of RR and high priority MLFB quantums */  
 #define SIXTY_FOUR_KB	65536		/* size of medium and low priority MLFB quantums */
+#define MAX_LEVELS	16		/* most MLFB levels */
+#define CLIENT_BUCKETS	64		/* hash buckets of the client groups of a scheduler */
+#define MAX_WEIGHTS	64		/* most clients given a weight */
+#define SRPT_AGING	25		/* default percent of the bytes sent since a job arrived
+					   that are taken off its length with SRPT */
 
 
 extern int globalSequence;		/* The sequence number given to the next RCB */
 
+/* A first in, first out queue of RCBs, linked through their next pointers.
+ */
+struct RcbQueue {
+	struct RequestControlBlock *first;	/* taken next */
+	struct RequestControlBlock *last;	/* added after */
+};
+
+/* A binary min-heap of RCBs for SJF and SRPT, ordered by priority and
+ * then by sequence number, so that jobs of the same length run in order.
+ */
+struct RcbHeap {
+	struct RequestControlBlock **rcbs;	/* rcbs[0] is the shortest job */
+	int count;
+	int capacity;
+};
+
+/* The jobs of one client, with fair scheduling. A group only exists while
+ * it has jobs in the queues, and takes turns with the other groups by
+ * deficit round robin: it may send as many bytes as it has credit, and
+ * gets its weight times the fair quantum more each time its turn ends.
+ */
+struct ClientGroup {
+	unsigned int client;			/* address of the client */
+	int weight;
+	long deficit;				/* bytes it may still send in its turn */
+	int jobs;				/* in its levels */
+	struct RcbQueue levels[MAX_LEVELS];	/* as in the scheduler, for RR or MLFB */
+	struct ClientGroup *nextInBucket;
+	struct ClientGroup *nextActive;		/* whose turn comes next */
+};
+
+/* The queues of one scheduler. Each worker thread has its own, and the
+ * lock makes it safe for other threads to add jobs or steal them.
+ */
+struct Scheduler {
+	pthread_mutex_t lock;			/* held while the queues are changed */
+	int queueSize;				/* number of RCBs with a file held by this scheduler */
+	struct RcbHeap sjf;			/* the jobs, with the SJF and SRPT schedulers */
+	struct RcbQueue levels[MAX_LEVELS];	/* the jobs with RR in levels[0], or the MLFB levels,
+						   highest priority first */
+	/*The following are only used with fair scheduling */
+	struct ClientGroup *buckets[CLIENT_BUCKETS];	/* the groups, by client */
+	struct ClientGroup *firstGroup;		/* whose turn it is */
+	struct ClientGroup *lastGroup;
+};
+
+/* The scheduling policy that every scheduler follows, chosen once with
+ * setScheduler. Each function is called with the scheduler lock held.
+ */
+struct SchedulerOps {
+	const char *name;
+	/* adds a new job */
+	void (*enqueue)(struct Scheduler *sched, struct RequestControlBlock *rcb);
+	/* takes the job to run next, or returns NULL if there is none */
+	struct RequestControlBlock* (*dequeue)(struct Scheduler *sched);
+	/* puts back a job that used its whole quantum and is not done */
+	void (*requeue)(struct Scheduler *sched, struct RequestControlBlock *rcb);
+	/* puts back a job that was blocked, without changing its priority */
+	void (*resume)(struct Scheduler *sched, struct RequestControlBlock *rcb);
+	/* accounts for the bytes a job sent in its quantum, NULL if the policy does not */
+	void (*charge)(struct Scheduler *sched, struct RequestControlBlock *rcb, int len);
+};
+
+/* This function chooses the scheduler type, "SJF", "SRPT", "RR" or "MLFB",
+ * before any scheduler is set up. quanta are the quantums in bytes of the
+ * MLFB levels, highest priority first: a job starts in the first level and
+ * moves down a level each time it uses up its quantum, and the jobs in the
+ * last level take turns. RR only has one level, and SRPT picks the job
+ * with the least left to send again after each quantum of the first
+ * level. quanta may be NULL for the defaults of 8 KB for RR and SRPT, and
+ * 8, 64 and 64 KB for MLFB.
+ * It returns 0 on success, -1 if the type or the levels are not valid.
+ */
+extern int setScheduler(const char *type, const int *quanta, int numLevels);
+
+/* This function sets how SRPT ages the jobs that wait, so that long ones
+ * still finish while short ones keep arriving: for every 100 bytes sent
+ * after a job arrived, its length counts for percent bytes less. A job
+ * with n bytes left then runs before any job that arrives once 100 * n /
+ * percent more bytes have been sent. 0 turns aging off, and the default
+ * is SRPT_AGING. It returns 0 on success, -1 if percent is negative.
+ */
+extern int setAging(int percent);
+
+/* This function makes RR and MLFB fair between clients rather than
+ * between requests: the jobs of each client address take turns within
+ * their own RR or MLFB levels, and the clients take turns by deficit
+ * round robin, each sending about quantum bytes, times its weight, per
+ * round. It must be called after setScheduler and before any scheduler
+ * is set up. It returns 0 on success, -1 if quantum is not positive, the
+ * scheduler is SJF or SRPT, or out of memory.
+ */
+extern int setFairness(int quantum);
+
+/* This function gives a client address a weight other than 1 with fair
+ * scheduling, so that it gets weight times as many bytes per round.
+ * It returns 0 on success, -1 if weight is not positive or MAX_WEIGHTS
+ * clients already have one.
+ */
+extern int setClientWeight(unsigned int client, int weight);
+
+/* This function sets up the empty queues of a scheduler. It aborts if
+ * memory cannot be allocated, as does adding a job when the SJF heap has
+ * to grow.
+ */
+extern void initScheduler(struct Scheduler *sched);
+
+/* This function creates the pool the RCBs of every scheduler are allocated
+ * from, with room for rcbs of them up front. It must be called before the
+ * first RCB is created. It returns 0 if successful, -1 if out of memory.
+ */
+extern int initRcbPool(int rcbs);
+
 /* This function is for testing only.
  * It currently prints out the sequence numbers of the first n RCBs,
  * but feel free to change this to suit your needs 
  */
-extern void displayQueue(int n);
+extern void displayQueue(struct Scheduler *sched, int n);
 
-/* This function initializes the sequence numbers of the RCBs in the 
- * queues to -1. This allows for easily finding available spots. 
+/* This function sets how many RCBs with a file each scheduler holds at
+ * most, RCB_QUEUE_SIZE by default. RCBs without one, such as the ones of
+ * error responses, are always taken, so that a server that is full can
+ * still say so. It returns 0 on success, -1 if rcbs is not positive.
  */
-extern void initializeQueue();
+extern int setQueueBound(int rcbs);
 
-/* This function finds the first empty slot in the queue, creates
- * an RCB and adds it to the queue.
- * If no spots are available, the function returns 0. Otherwise it returns 1. 
+/* This function creates an RCB from the rcb pool and adds it to the
+ * queues of sched. client is the address of the
+ * client, which only matters with fair scheduling. cfd is the cache descriptor of the
+ * file, or -1 for a response without a body, in which case sz should be 0.
+ * The RCB keeps the cached contents or the open file of cfd, so that it
+ * can be sent from any offset without going through the cache. The header is sent
+ * before the file and must stay valid until the RCB is removed.
+ * times, if not NULL, is where the server times the phases of the request;
+ * the scheduler only keeps it in the RCB.
+ * It returns 1 on success, or 0 if the scheduler already holds its bound of
+ * RCBs with a file, if there is no memory or if cfd cannot be read.
  */
-extern int createRCB(int fd, FILE* fh, int sz, char* type);
+extern int createRCB(struct Scheduler *sched, int fd, unsigned int client, int cfd, int sz, const char *header, int headerLength,
+		     struct request_times *times);
 
-/* This function resets an RCB to default values to make it available
- */ 
+/* This function returns an RCB to the rcb pool, and frees its place in
+ * the queue bound if it has a file.
+ */
 void removeRCB(struct RequestControlBlock *rcb);
 
-/* This function will grab the next RCB (based on the scheduling type
- * input parameter).
- * It will return a pointer to the rcb and set the lock value to 1 so
- * that it will not be grabbed again
+/* This function takes the next RCB off the queues, as the scheduler type
+ * picks it, or returns NULL if there is none. The RCB belongs to the caller
+ * until it is handed back with updateRCB or blockRCB.
  */
-extern struct RequestControlBlock* getNextJob(char* type);
+extern struct RequestControlBlock* getNextJob(struct Scheduler *sched);
+
+/* This function takes the job that victim would run next and moves it to
+ * thief, so that an idle worker can help a busy one. It returns NULL if
+ * victim has no jobs waiting.
+ */
+extern struct RequestControlBlock* stealJob(struct Scheduler *thief, struct Scheduler *victim);
+
+/* This function returns 1 if there are jobs waiting in the queues, 0 if not.
+ */
+extern int hasJobs(struct Scheduler *sched);
 
 /* This function will update or remove the RCB after processing, based on scheduling type.
  * It will subtract len from the lengthRemaining. 
- * If there are still bytes to send the rcb will be unlocked (added back to the queue).
- * Otherwise the rbc will be removed and the connection and file will be closed. 
+ * If there are still bytes to send the rcb is put back in the queue.
+ * Otherwise the rcb is removed and its cache descriptor is closed. The connection
+ * is left open so that the caller can send the next response on it.
+ * It returns 1 if the rcb was removed, 0 if it is still in use.
+ */
+extern int updateRCB(int len, struct RequestControlBlock* rcb);
+
+/* This function is used instead of updateRCB when the client socket could not
+ * take the whole quantum. It subtracts len from the lengthRemaining but does not
+ * put the RCB back in the queue, so that it can wait for the socket to drain.
+ */
+extern void blockRCB(int len, struct RequestControlBlock* rcb);
+
+/* This function puts an RCB that was blocked with blockRCB back in the queue
+ * without changing its priority.
+ * updateRCB, blockRCB and resumeRCB work on the scheduler that holds the RCB.
  */
-extern void updateRCB(char* type, int len, struct RequestControlBlock* rcb);
+extern void resumeRCB(struct RequestControlBlock* rcb);
 
 
 
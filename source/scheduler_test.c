@@ -0,0 +1,231 @@
+
+#include "scheduler.h"
+#include "rcb.h"
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/* Takes the next job, checks its size, and finishes it */
+void expect_next( struct Scheduler* sched, int size ) {
+  struct RequestControlBlock* rcb = getNextJob( sched );
+  assert( rcb && rcb->lengthRemaining == size );
+  assert( updateRCB( rcb->lengthRemaining, rcb ));
+}
+
+/* Runs a quantum of the next jobs, which must be of the clients given */
+void expect_clients( struct Scheduler* sched, const char* clients ) {
+  struct RequestControlBlock* rcb;
+  for( ; *clients; ++clients ) {
+    rcb = getNextJob( sched );
+    assert( rcb && rcb->client == (unsigned int) ( *clients - '0' ));
+    updateRCB( rcb->quantum, rcb );
+  }
+}
+
+struct Scheduler sched, thief;
+
+int main() {
+
+  struct RequestControlBlock* rcb;
+  int sizes[] = { 50, 10, 30, 10, 20 };
+  int ladder[] = { 10, 20, 40, 80 };
+  int bad[] = { 10, 0 };
+  int srpt[] = { 10 };
+  int i, last, cfd;
+
+  assert( 0 == initRcbPool( RCB_QUEUE_SIZE ));
+  initScheduler( &sched );
+
+  assert( setScheduler( "SJF", NULL, 0 ) == 0 );
+
+  /* SJF: shortest first, in arrival order when equal */
+  for( i = 0; i < 5; ++i ) {
+    assert( createRCB( &sched, i, 0, -1, sizes[i], "", 0, NULL ));
+  }
+  rcb = getNextJob( &sched );
+  assert( rcb->lengthRemaining == 10 && rcb->fileDescriptor == 1 );
+  assert( updateRCB( 10, rcb ));
+  expect_next( &sched, 10 );
+  expect_next( &sched, 20 );
+  expect_next( &sched, 30 );
+  expect_next( &sched, 50 );
+  assert( !hasJobs( &sched ) && NULL == getNextJob( &sched ));
+
+  /* A full heap comes out sorted */
+  srand( 1 );
+  for( i = 0; i < RCB_QUEUE_SIZE; ++i ) {
+    assert( createRCB( &sched, i, 0, -1, rand() % 1000, "", 0, NULL ));
+  }
+  for( last = -1; ( rcb = getNextJob( &sched )); ) {
+    assert( rcb->lengthRemaining >= last );
+    last = rcb->lengthRemaining;
+    updateRCB( last, rcb );
+  }
+
+  /* SRPT: a short job that arrives goes ahead of a long one that ran */
+  assert( setScheduler( "SRPT", srpt, 1 ) == 0 && setAging( 0 ) == 0 );
+  assert( createRCB( &sched, 1, 0, -1, 100, "", 0, NULL ));
+  rcb = getNextJob( &sched );
+  assert( rcb->quantum == 10 && !updateRCB( 10, rcb ));
+  assert( createRCB( &sched, 2, 0, -1, 20, "", 0, NULL ));
+  rcb = getNextJob( &sched );
+  assert( rcb->fileDescriptor == 2 && !updateRCB( 10, rcb ));
+  expect_next( &sched, 10 );
+  expect_next( &sched, 90 );
+
+  /* and a long job that waited goes ahead of a shorter one that arrives */
+  assert( setAging( -1 ) == -1 && setAging( 100 ) == 0 );
+  assert( createRCB( &sched, 1, 0, -1, 100, "", 0, NULL ));
+  rcb = getNextJob( &sched );
+  assert( !updateRCB( 10, rcb ));                   /* 90 left */
+  assert( createRCB( &sched, 2, 0, -1, 50, "", 0, NULL ));
+  for( i = 50; i > 0; i -= 10 ) {                   /* 60 bytes later */
+    rcb = getNextJob( &sched );
+    assert( rcb->fileDescriptor == 2 );
+    updateRCB( 10, rcb );
+  }
+  assert( createRCB( &sched, 3, 0, -1, 40, "", 0, NULL ));
+  rcb = getNextJob( &sched );
+  assert( rcb->fileDescriptor == 1 && !updateRCB( 10, rcb ));
+  assert( createRCB( &sched, 4, 0, -1, 85, "", 0, NULL ));   /* 80 left, still ahead */
+  rcb = getNextJob( &sched );
+  assert( rcb->fileDescriptor == 1 );
+  updateRCB( rcb->lengthRemaining, rcb );
+  expect_next( &sched, 40 );
+  expect_next( &sched, 85 );
+  assert( !hasJobs( &sched ));
+
+  /* The clock goes on by the bytes sent, not by the quantum */
+  assert( createRCB( &sched, 1, 0, -1, 100, "", 0, NULL ));
+  rcb = getNextJob( &sched );
+  assert( rcb->quantum == 10 && !updateRCB( 40, rcb ));     /* 60 left */
+  assert( createRCB( &sched, 2, 0, -1, 25, "", 0, NULL ));  /* 65 with its age */
+  rcb = getNextJob( &sched );
+  assert( rcb->fileDescriptor == 1 );
+  updateRCB( rcb->lengthRemaining, rcb );
+  expect_next( &sched, 25 );
+
+  assert( setScheduler( "RR", NULL, 0 ) == 0 );
+
+  /* RR: a job that isn't done goes to the back */
+  assert( createRCB( &sched, 1, 0, -1, 3 * EIGHT_KB, "", 0, NULL ));
+  assert( createRCB( &sched, 2, 0, -1, EIGHT_KB, "", 0, NULL ));
+  rcb = getNextJob( &sched );
+  assert( rcb->fileDescriptor == 1 && !updateRCB( EIGHT_KB, rcb ));
+  rcb = getNextJob( &sched );
+  assert( rcb->fileDescriptor == 2 && updateRCB( EIGHT_KB, rcb ));
+  rcb = getNextJob( &sched );
+  assert( rcb->fileDescriptor == 1 && !updateRCB( EIGHT_KB, rcb ));
+  expect_next( &sched, EIGHT_KB );
+
+  assert( setScheduler( "MLFB", NULL, 0 ) == 0 );
+
+  /* MLFB: a demoted job waits for the new ones */
+  assert( createRCB( &sched, 1, 0, -1, 4 * SIXTY_FOUR_KB, "", 0, NULL ));
+  rcb = getNextJob( &sched );
+  assert( rcb->quantum == EIGHT_KB && !updateRCB( EIGHT_KB, rcb ));
+  assert( createRCB( &sched, 2, 0, -1, EIGHT_KB, "", 0, NULL ));
+  rcb = getNextJob( &sched );
+  assert( rcb->fileDescriptor == 2 && updateRCB( EIGHT_KB, rcb ));
+  rcb = getNextJob( &sched );
+  assert( rcb->fileDescriptor == 1 && rcb->quantum == SIXTY_FOUR_KB );
+  assert( !updateRCB( SIXTY_FOUR_KB, rcb ));
+  assert( createRCB( &sched, 3, 0, -1, 2 * SIXTY_FOUR_KB, "", 0, NULL ));
+  rcb = getNextJob( &sched );
+  assert( rcb->fileDescriptor == 3 && !updateRCB( EIGHT_KB, rcb ));
+  rcb = getNextJob( &sched );                /* medium before low */
+  assert( rcb->fileDescriptor == 3 );
+  updateRCB( rcb->lengthRemaining, rcb );
+  rcb = getNextJob( &sched );
+  assert( rcb->fileDescriptor == 1 );
+  updateRCB( rcb->lengthRemaining, rcb );
+  assert( !hasJobs( &sched ));
+
+  /* A ladder of four levels, the last one round robin */
+  assert( setScheduler( "MLFB", ladder, 0 ) == -1 );
+  assert( setScheduler( "MLFB", bad, 2 ) == -1 );
+  assert( setScheduler( "FIFO", NULL, 0 ) == -1 );
+  assert( setScheduler( "MLFB", ladder, 4 ) == 0 );
+  assert( createRCB( &sched, 1, 0, -1, 1000, "", 0, NULL ));
+  for( i = 0; i < 4; ++i ) {
+    rcb = getNextJob( &sched );
+    assert( rcb->level == i && rcb->quantum == ladder[i] );
+    assert( !updateRCB( ladder[i], rcb ));
+  }
+  assert( createRCB( &sched, 2, 0, -1, 10, "", 0, NULL ));
+  expect_next( &sched, 10 );                        /* new jobs first */
+  rcb = getNextJob( &sched );
+  assert( rcb->level == 3 && rcb->quantum == ladder[3] );
+  assert( !updateRCB( ladder[3], rcb ));
+  rcb = getNextJob( &sched );                       /* stays at the bottom */
+  assert( rcb->level == 3 && rcb->quantum == ladder[3] );
+  assert( updateRCB( rcb->lengthRemaining, rcb ));
+  assert( !hasJobs( &sched ));
+
+  /* Fair RR: the clients take turns, not their requests */
+  assert( setScheduler( "RR", srpt, 1 ) == 0 && setFairness( 10 ) == 0 );
+  for( i = 1; i <= 3; ++i ) {
+    assert( createRCB( &sched, i, 1, -1, 30, "", 0, NULL ));
+  }
+  assert( createRCB( &sched, 4, 2, -1, 30, "", 0, NULL ));
+  expect_clients( &sched, "121212111111" );
+  assert( !hasJobs( &sched ));
+
+  /* and a client with twice the weight sends twice as much per round */
+  assert( setScheduler( "MLFB", NULL, 0 ) == 0 && setFairness( 0 ) == -1 );
+  assert( setScheduler( "MLFB", srpt, 1 ) == 0 && setFairness( 10 ) == 0 );
+  assert( setClientWeight( 3, 0 ) == -1 && setClientWeight( 3, 2 ) == 0 );
+  for( i = 1; i <= 2; ++i ) {
+    assert( createRCB( &sched, i, 1, -1, 40, "", 0, NULL ));
+    assert( createRCB( &sched, i + 4, 3, -1, 40, "", 0, NULL ));
+  }
+  expect_clients( &sched, "1331331331331111" );
+  assert( !hasJobs( &sched ));
+
+  /* A client pays for what its job sent, and one that sent twice its
+   * credit sits out a round */
+  assert( setScheduler( "RR", srpt, 1 ) == 0 && setFairness( 10 ) == 0 );
+  assert( createRCB( &sched, 1, 5, -1, 30, "", 0, NULL ));
+  assert( createRCB( &sched, 2, 5, -1, 30, "", 0, NULL ));
+  assert( createRCB( &sched, 3, 6, -1, 30, "", 0, NULL ));
+  rcb = getNextJob( &sched );
+  assert( rcb->client == 5 && !updateRCB( 20, rcb ));
+  expect_clients( &sched, "665" );
+  while(( rcb = getNextJob( &sched ))) {
+    updateRCB( rcb->lengthRemaining, rcb );
+  }
+  /* and a job that is stolen is paid for where its client got the credit */
+  initScheduler( &thief );
+  assert( createRCB( &sched, 1, 7, -1, 30, "", 0, NULL ));
+  assert( createRCB( &sched, 2, 7, -1, 30, "", 0, NULL ));
+  assert( createRCB( &sched, 3, 8, -1, 30, "", 0, NULL ));
+  rcb = stealJob( &thief, &sched );
+  assert( rcb->client == 7 && rcb->scheduler == &thief && !updateRCB( 20, rcb ));
+  expect_clients( &sched, "8" );
+  while(( rcb = getNextJob( &sched )) || ( rcb = getNextJob( &thief ))) {
+    updateRCB( rcb->lengthRemaining, rcb );
+  }
+  assert( setScheduler( "SJF", NULL, 0 ) == 0 && setFairness( 10 ) == -1 );
+
+  /* Only the jobs with a file count against the bound */
+  assert( 0 == cache_init( 1024, NULL ) && setQueueBound( 0 ) == -1 );
+  assert( setScheduler( "RR", NULL, 0 ) == 0 && setQueueBound( 2 ) == 0 );
+  for( i = 1; i <= 3; ++i ) {
+    cfd = cache_open( "scheduler_test.c" );
+    assert( cfd >= 0 && createRCB( &sched, i, 0, cfd, 1, "", 0, NULL ) == ( i < 3 ));
+  }
+  cache_close( cfd );
+  assert( createRCB( &sched, 4, 0, -1, 0, "", 0, NULL ));
+  expect_next( &sched, 1 );
+  cfd = cache_open( "scheduler_test.c" );
+  assert( createRCB( &sched, 3, 0, cfd, 1, "", 0, NULL ));
+  for( i = 0; i < 3; ++i ) {
+    rcb = getNextJob( &sched );
+    assert( updateRCB( rcb->lengthRemaining, rcb ));
+  }
+  assert( !hasJobs( &sched ) && sched.queueSize == 0 );
+
+  return EXIT_SUCCESS;
+
+}
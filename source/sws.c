@@ -11,139 +11,974 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/stat.h>			   /* using fstat to get file size */
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <arpa/inet.h>
 
 #include "network.h"
 #include "scheduler.h"
 #include "rcb.h"
+#include "http.h"
+#include "worker.h"
+#include "cache.h"
+#include "pool.h"
+#include "latency.h"
 
 
 
-char* schedType;			   /* the type of scheduler to use */
+#define USAGE \
+  "usage: sws <port> <scheduler> [-l listeners] [-b backlog] [-d defer] [-k timeout] [-u] [-w workers] [-c kbytes] [-m] [-p policy]\n" \
+  "           [-q kbytes,...] [-a percent] [-f kbytes] [-W address:weight]\n" \
+  "           [-Q min,max] [-r requests[,kbytes]]\n" \
+  "  scheduler    : SJF, SRPT, RR or MLFB\n" \
+  "  -l listeners : number of SO_REUSEPORT listening sockets (default one\n" \
+  "                 per worker, or 1); the kernel spreads the clients\n" \
+  "                 between them, but the main thread accepts them all\n" \
+  "  -b backlog   : accept queue length of each listener (default 64)\n" \
+  "  -d defer     : only accept clients once their request has arrived,\n" \
+  "                 waiting at most defer seconds (default off)\n" \
+  "  -k timeout   : seconds an idle keep-alive connection is kept open,\n" \
+  "                 0 closes every connection after one response (default 5)\n" \
+  "  -u           : use io_uring for network I/O if the kernel supports it\n" \
+  "  -w workers   : send the responses from a pool of worker threads, each\n" \
+  "                 with its own queues (default 0, no pool)\n" \
+  "  -c kbytes    : size of the file cache in kilobytes (default 16384)\n" \
+  "  -m           : map cached files with mmap instead of copying them\n" \
+  "  -p policy    : cache replacement policy, lru, arc or gdsf, with\n" \
+  "                 +tinylfu to only cache files asked for more often than\n" \
+  "                 the ones they would evict (default lru)\n" \
+  "  -q kbytes,...: quantum of each MLFB level in kilobytes, highest\n" \
+  "                 priority first, up to 16 levels (default 8,64,64);\n" \
+  "                 RR and SRPT use the first one\n" \
+  "  -a percent   : with SRPT, how much of the bytes sent while a job\n" \
+  "                 waits are taken off its length (default 25)\n" \
+  "  -f kbytes    : with RR or MLFB, be fair between client addresses\n" \
+  "                 rather than requests, each sending kbytes per round\n" \
+  "  -W address:weight : with -f, give a client weight times as many\n" \
+  "                 bytes per round, may be repeated (default 1)\n" \
+  "  -Q min,max   : size each quantum from the free space in the client's\n" \
+  "                 send buffer, between min and max kilobytes (default\n" \
+  "                 off, the scheduler's quanta)\n" \
+  "  -r requests[,kbytes] : most responses with a file, and optionally\n" \
+  "                 most kilobytes of them, queued at once; requests past\n" \
+  "                 that get 503 (default 64 per worker, any size)\n" \
+  "  The cache hit ratios, the occupancy of the memory pools, the\n" \
+  "  requests turned away and the percentiles of the time the requests\n" \
+  "  spent in each phase are printed on SIGUSR1 and on exit.\n"
 
-/* This function takes a file handle to a client, reads in the request, 
- *    parses the request, and sends back the requested file.  If the
- *    request is improper or the file is not available, the appropriate
- *    error is sent back.
- * Changes for project: Instead of sending back the file, it creates an
- * 	RCB block and adds it to the scheduler queue.
- * Parameters: 
- *             fd : the file descriptor to the client connection
+#define KEEP_ALIVE_TIMEOUT	5	   /* default idle time of a connection */
+#define CACHE_KBYTES		16384	   /* default size of the file cache */
+#define PIPELINE_DEPTH		16	   /* responses queued before reading stops */
+#define QUANTA_PER_POLL		1	   /* quanta run between looks at the network */
+#define RESPONSE_HEADER_SIZE	128	   /* room for the status line and headers */
+#define RETRY_AFTER		"1"	   /* seconds a client turned away waits */
+
+/* Results of sending a quantum of a job */
+#define JOB_QUEUED		0	   /* the rcb is back in the queue */
+#define JOB_BLOCKED		1	   /* the rcb waits for the socket to drain */
+#define JOB_DONE		2	   /* the whole response was sent */
+#define JOB_FAILED		3	   /* the response could not be sent */
+
+static int keepAliveTimeout = KEEP_ALIVE_TIMEOUT;  /* seconds, 0 for none */
+static int maxAdmitted = 0;		   /* most responses with a file at once */
+static long long maxAdmittedBytes = 0;	   /* and most bytes of them, 0 for any */
+static int admitted = 0;		   /* responses with a file, queued or sent */
+static long long admittedBytes = 0;	   /* and the size of their files */
+static long rejected = 0;		   /* requests answered with 503 */
+static int minQuantum = 0;		   /* bounds of the quanta sized from the */
+static int maxQuantum = 0;		   /* send buffers, 0 for the scheduler's */
+
+/* A response to one request.  Responses are sent in the order the requests
+ * arrived, so a response waits on its connection until the ones before it
+ * have been sent, and only then gets an RCB.
+ */
+struct Response {
+	struct Response *next;		   /* next response on the connection */
+	int cfd;			   /* cache descriptor of the file, -1 for an error */
+	int size;			   /* size of the file */
+	int admitted;			   /* 1 if it counts against the admission bounds */
+	int headerLength;		   /* length of the header */
+	char header[RESPONSE_HEADER_SIZE]; /* status line and headers */
+	struct request_times times;	   /* when each phase of it began */
+};
+
+/* Per-client state kept by the event loop, indexed by file descriptor */
+struct Connection {
+	int open;			   /* 1 while the client is connected */
+	char *request;			   /* request buffer, kept for the next client */
+	int requestLength;		   /* bytes read into the buffer */
+	struct HttpParser parser;	   /* where parsing the request stopped */
+	struct Response *current;	   /* response being sent, NULL if idle */
+	struct Response *firstPending;	   /* pipelined responses, in order */
+	struct Response *lastPending;
+	int numPending;			   /* number of pipelined responses */
+	int closing;			   /* no more requests, close when done */
+	time_t idleSince;		   /* when the connection went idle, or 0 */
+	struct RequestControlBlock *blocked;  /* rcb waiting for the socket to drain */
+	int writable;			   /* socket became writable with no rcb blocked */
+	struct RequestControlBlock *sending;  /* rcb with an io_uring transfer in flight */
+	int quantum;			   /* size of the current io_uring quantum */
+	int quantumSent;		   /* bytes of the current quantum sent so far */
+	unsigned int client;		   /* address of the client */
+	long long accepted;		   /* when it connected, until the first request */
+};
+
+static struct Connection *connections = NULL;  /* table of client states */
+static int numConnections = 0;		   /* number of entries in the table */
+static int openConnections = 0;		   /* number of connected clients */
+static struct RequestControlBlock *noBuffer = NULL;  /* rcb waiting for an io_uring buffer */
+static struct Scheduler scheduler;	   /* queues, when there is no worker pool */
+static int numWorkers = 0;		   /* worker threads, 0 for none */
+static struct pool *responsePool = NULL;   /* where the responses come from */
+
+/* The result of a job a worker finished or blocked, passed back to the
+ * main thread, which owns the connections.
+ */
+struct Completion {
+	struct Completion *next;
+	int fd;				   /* the client socket */
+	int result;			   /* JOB_BLOCKED, JOB_DONE or JOB_FAILED */
+	struct RequestControlBlock *rcb;   /* the blocked rcb, or NULL */
+};
+
+static struct pool *completionPool = NULL;  /* allocated by workers, freed by main */
+static pthread_mutex_t completionLock = PTHREAD_MUTEX_INITIALIZER;
+static struct Completion *firstCompletion = NULL;  /* in the order they happened */
+static struct Completion *lastCompletion = NULL;
+static int completionFd = -1;		   /* eventfd signalled on completions */
+static volatile sig_atomic_t reportWanted = 0;	   /* SIGUSR1 */
+static volatile sig_atomic_t exitWanted = 0;	   /* SIGINT or SIGTERM */
+
+static void serve_client( int fd );
+
+/* This function returns the state of the client on socket fd, growing the
+ * table if needed. It aborts if memory cannot be allocated.
+ */
+static struct Connection* getConnection( int fd ) {
+  if( fd >= numConnections ) {
+    int newSize = numConnections ? numConnections : 64;
+    struct Connection *tmp;
+
+    while( newSize <= fd ) {
+      newSize *= 2;
+    }
+    tmp = realloc( connections, newSize * sizeof( struct Connection ) );
+    if( !tmp ) {
+      perror( "Error while allocating memory" );
+      abort();
+    }
+    memset( tmp + numConnections, 0,
+            ( newSize - numConnections ) * sizeof( struct Connection ) );
+    connections = tmp;
+    numConnections = newSize;
+  }
+  return &connections[fd];
+}
+
+/* This function clears the state of a newly accepted client on socket fd.
+ * The request buffer of the previous client on fd is kept for reuse.
+ */
+static void resetConnection( int fd ) {
+  struct Connection *conn = getConnection( fd );
+  char *request = conn->request;
+
+  memset( conn, 0, sizeof( struct Connection ) );
+  conn->request = request;
+  conn->open = 1;
+  conn->client = network_peer( fd );
+  conn->accepted = latency_now();
+  conn->idleSince = time( NULL );
+  httpInit( &conn->parser );
+  openConnections++;
+}
+
+/* This function frees a response, closing its file if it is still open.
+ */
+static void freeResponse( struct Response *resp ) {
+  if( resp->cfd >= 0 ) {
+    cache_close( resp->cfd );
+  }
+  if( resp->admitted ) {
+    admitted--;
+    admittedBytes -= resp->size;
+  }
+  pool_free( responsePool, resp );
+}
+
+/* This function closes the connection on socket fd and drops the responses
+ *    still queued on it.  It must not be called while an rcb of the
+ *    connection is in the scheduler.
+ * Parameters:
+ *             fd : the client socket
  * Returns: None
  */
-static void serve_client( int fd ) {
-  static char *buffer;                              /* request buffer */
-  char *req = NULL;                                 /* ptr to req file */
-  char *brk;                                        /* state used by strtok */
-  char *tmp;                                        /* error checking ptr */
-  FILE *fin;                                        /* input file handle */
+static void closeConnection( int fd ) {
+  struct Connection *conn = getConnection( fd );
+  struct Response *resp;
+
+  if( conn->current ) {
+    freeResponse( conn->current );
+    conn->current = NULL;
+  }
+  while( conn->firstPending ) {
+    resp = conn->firstPending;
+    conn->firstPending = resp->next;
+    freeResponse( resp );
+  }
+  conn->lastPending = NULL;
+  conn->numPending = 0;
+  conn->open = 0;
+  openConnections--;
+  network_close( fd );
+}
+
+/* This function closes every connection that has been idle for longer
+ *    than the keep-alive timeout, including ones that never finished
+ *    sending a request.
+ * Parameters:
+ *             now : the current time
+ * Returns: None
+ */
+static void closeIdleConnections( time_t now ) {
+  int fd;
+
+  for( fd = 0; fd < numConnections; fd++ ) {
+    struct Connection *conn = &connections[fd];
+
+    if( conn->open && !conn->current && conn->idleSince &&
+        ( now - conn->idleSince >= keepAliveTimeout ) ) {
+      closeConnection( fd );
+    }
+  }
+}
+
+/* This function hands the next queued response of a connection to the
+ *    scheduler.  If there is none, the connection is closed if the client
+ *    is done with it, or else left idle until the next request arrives.
+ * Parameters:
+ *             fd : the client socket
+ * Returns: None
+ */
+static void nextResponse( int fd ) {
+  struct Connection *conn = getConnection( fd );
+
+  if( conn->current ) {                             /* still sending one */
+    return;
+  } else if( conn->firstPending ) {
+    conn->current = conn->firstPending;
+    conn->firstPending = conn->current->next;
+    if( !conn->firstPending ) {
+      conn->lastPending = NULL;
+    }
+    conn->numPending--;
+    conn->idleSince = 0;
+    conn->writable = 0;
+    conn->current->times.enqueued = latency_now();
+    if( !createRCB( numWorkers ? nextWorkerScheduler() : &scheduler, fd,
+                    conn->client, conn->current->cfd, conn->current->size,
+                    conn->current->header, conn->current->headerLength,
+                    &conn->current->times ) ) {
+      fprintf( stderr, "Too many requests, closing connection\n" );
+      closeConnection( fd );
+      return;
+    }
+    conn->current->cfd = -1;                        /* the rcb owns it now */
+    if( numWorkers ) {
+      wakeWorkers();
+    }
+  } else if( conn->closing ) {
+    closeConnection( fd );
+  } else if( !conn->idleSince ) {
+    conn->idleSince = time( NULL );                 /* wait for a request */
+  }
+}
+
+/* This function is called once the rcb of the current response of a
+ *    connection is done.  It moves on to the next pipelined response, or
+ *    reads the next request if there is none.
+ * Parameters:
+ *             fd : the client socket
+ *             complete : 1 if the whole response was sent, 0 if sending it
+ *                        failed, in which case the connection is closed
+ * Returns: None
+ */
+static void finishResponse( int fd, int complete ) {
+  struct Connection *conn = getConnection( fd );
+
+  if( complete && conn->current->admitted ) {       /* time the files sent */
+    conn->current->times.finished = latency_now();
+    latency_add( &conn->current->times );
+  }
+  freeResponse( conn->current );                    /* file closed by rcb */
+  conn->current = NULL;
+  if( !complete ) {
+    closeConnection( fd );
+    return;
+  }
+  nextResponse( fd );
+  if( conn->open && !conn->current ) {
+    serve_client( fd );                             /* look for more requests */
+  }
+}
+
+/* This function reads as much of the request on socket fd as is available
+ *    and parses it.  The request may arrive in any number of pieces; the
+ *    data read so far and the parser state are kept in the connection.
+ *    Data that is already in the buffer, such as pipelined requests, is
+ *    parsed before anything is read.
+ * Parameters:
+ *             fd : the file descriptor to the client connection
+ * Returns: HTTP_DONE once the whole request has been read, HTTP_NEED_MORE if
+ *          the client has not sent all of it yet, HTTP_ERROR if it is not a
+ *          valid request, or -2 if the client went away.
+ */
+static int readRequest( int fd ) {
+  struct Connection *conn = getConnection( fd );
   int len;                                          /* length of data read */
-  int sz;					    /* size of file */
+  int status;
 
-  if( !buffer ) {                                   /* 1st time, alloc buffer */
-    buffer = malloc( MAX_HTTP_SIZE );
-    if( !buffer ) {                                 /* error check */
+  if( !conn->request ) {                            /* 1st time, alloc buffer */
+    conn->request = malloc( MAX_HTTP_SIZE );
+    if( !conn->request ) {                          /* error check */
       perror( "Error while allocating memory" );
       abort();
     }
   }
 
-  memset( buffer, 0, MAX_HTTP_SIZE );
-  if( read( fd, buffer, MAX_HTTP_SIZE ) <= 0 ) {    /* read req from client */
-    perror( "Error while reading request" );
+  status = httpParse( &conn->parser, conn->request, conn->requestLength );
+  while( status == HTTP_NEED_MORE ) {
+    if( conn->requestLength >= MAX_HTTP_SIZE - 1 ) {
+      return HTTP_ERROR;                            /* request is too long */
+    }
+    len = network_read( fd, conn->request + conn->requestLength,
+                        MAX_HTTP_SIZE - 1 - conn->requestLength );
+    if( ( len < 0 ) && ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) ) {
+      return HTTP_NEED_MORE;                        /* wait for the rest */
+    } else if( len <= 0 ) {                         /* client went away */
+      return -2;
+    }
+    conn->requestLength += len;
+    status = httpParse( &conn->parser, conn->request, conn->requestLength );
+  }
+  return status;
+}
+
+/* This function checks whether the client wants the connection kept open
+ *    after the response to the request that was just parsed.  HTTP/1.1
+ *    connections are kept open unless the client asks for them to be
+ *    closed, HTTP/1.0 ones only if it asks for keep-alive.
+ * Parameters:
+ *             conn : the client connection
+ * Returns: 1 if the connection should be kept open, 0 if not
+ */
+static int keepAlive( struct Connection *conn ) {
+  struct HttpHeader *header = httpFindHeader( &conn->parser, conn->request,
+                                              "Connection" );
+
+  if( keepAliveTimeout <= 0 ) {
+    return 0;
+  } else if( httpTokenIs( conn->request, conn->parser.version, "HTTP/1.1" ) ) {
+    return !header || !httpTokenIs( conn->request, header->value, "close" );
+  }
+  return header && httpTokenIs( conn->request, header->value, "keep-alive" );
+}
+
+/* This function decides whether the server has room for the response to
+ *    a request for a file of size bytes.  All the responses with a file,
+ *    from the one being sent to the last one pipelined, count until they
+ *    are sent.  A file bigger than the byte bound is only let in alone.
+ * Parameters:
+ *             size : the size of the file
+ * Returns: 1 if the response was admitted, 0 if the server is full.
+ */
+static int admit( int size ) {
+  if( ( admitted >= maxAdmitted ) || ( maxAdmittedBytes && admitted &&
+                                       ( admittedBytes + size > maxAdmittedBytes ) ) ) {
+    rejected++;
+    return 0;
+  }
+  admitted++;
+  admittedBytes += size;
+  return 1;
+}
+
+/* This function returns how many new clients to accept before the jobs
+ *    get another turn.  The fuller the server is, the fewer, so that the
+ *    clients it cannot serve yet wait in the listen backlog instead of
+ *    taking turns from the ones it is serving.  The budget is passed to
+ *    network_open(), so that no client is accepted and then left unopened.
+ *    At least one is accepted, so that every client still gets an answer,
+ *    if only a 503.
+ * Parameters: None
+ * Returns: The number of clients to accept.
+ */
+static int acceptBudget() {
+  int budget = NETWORK_ACCEPT_BATCH * ( maxAdmitted - admitted ) / maxAdmitted;
+
+  return ( budget > 0 ) ? budget : 1;
+}
+
+/* This function builds the response to the request that was just parsed
+ *    and removes the request from the connection buffer, keeping any
+ *    pipelined requests that follow it.
+ * Parameters:
+ *             fd : the file descriptor to the client connection
+ *             status : the result of parsing the request
+ * Returns: the response, which aborts if memory cannot be allocated
+ */
+static struct Response* makeResponse( int fd, int status ) {
+  struct Connection *conn = getConnection( fd );
+  struct HttpParser *parser = &conn->parser;
+  struct Response *resp = pool_alloc( responsePool );
+  const char *code;                                 /* status code and text */
+  const char *retry = "";                           /* Retry-After header */
+  char *req = NULL;                                 /* ptr to req file */
+
+  if( !resp ) {
+    perror( "Error while allocating memory" );
     abort();
-  } 
+  }
+  resp->next = NULL;
+  resp->cfd = -1;
+  resp->size = 0;
+  resp->admitted = 0;
+  memset( &resp->times, 0, sizeof( resp->times ) );
+  resp->times.accepted = conn->accepted;
+  resp->times.parsed = latency_now();
+  conn->accepted = 0;
 
   /* standard requests are of the form
    *   GET /foo/bar/qux.html HTTP/1.1
-   * We want the second token (the file path).
+   * We want the path, which is terminated in place to use it as a string.
    */
-  tmp = strtok_r( buffer, " ", &brk );              /* parse request */
-  if( tmp && !strcmp( "GET", tmp ) ) {
-    req = strtok_r( NULL, " ", &brk );
+  if( ( status == HTTP_DONE ) && httpTokenIs( conn->request, parser->method, "GET" )
+      && ( conn->request[parser->path.start] == '/' ) ) {
+    req = conn->request + parser->path.start;
   }
- 
+
   if( !req ) {                                      /* is req valid? */
-    len = sprintf( buffer, "HTTP/1.1 400 Bad request\n\n" );
-    write( fd, buffer, len );                       /* if not, send err */
+    code = "400 Bad request";
+    conn->closing = 1;                              /* cannot find the next */
   } else {                                          /* if so, open file */
+    if( !keepAlive( conn ) ) {
+      conn->closing = 1;
+    }
+    req[parser->path.length] = '\0';
     req++;                                          /* skip leading / */
-    fin = fopen( req, "r" );                        /* open file */
-    if( !fin ) {                                    /* check if successful */
-      len = sprintf( buffer, "HTTP/1.1 404 File not found\n\n" );  
-      write( fd, buffer, len );                     /* if not, send err */
-      fclose( fin);
+    resp->cfd = cache_open( req );                  /* only regular files */
+    if( resp->cfd < 0 ) {
+      code = "404 File not found";
+    } else if( admit( cache_filesize( resp->cfd ) ) ) {
+      code = "200 OK";
+      resp->size = cache_filesize( resp->cfd );     /* file size in bytes */
+      resp->times.cached = ( cache_hit( resp->cfd ) == 1 );
+      resp->admitted = 1;
+    } else {                                        /* turn it away now */
+      cache_close( resp->cfd );                     /* rather than let it */
+      resp->cfd = -1;                               /* wait for a turn */
+      code = "503 Service unavailable";
+      retry = "Retry-After: " RETRY_AFTER "\n";
+      conn->closing = 1;
     }
-    else {                                        /* if so, add file to queue */
-    /* Determine size of file
-     * Allocate and initialize a request control block
-     * Add RCB to queue
-     * Send back response status */
-      struct stat st;
-      fstat(fd, &st);				     /* get stats of file from file descriptor */
-      sz = st.st_size;				     /* extract file size in bytes from stats */
-      
-      createRCB(fd, fin, sz, schedType);	     /* create RCB and add it to queue */
+  }
+  resp->headerLength = snprintf( resp->header, RESPONSE_HEADER_SIZE,
+                                 "HTTP/1.1 %s\nContent-Length: %d\n%sConnection: %s\n\n",
+                                 code, resp->size, retry,
+                                 conn->closing ? "close" : "keep-alive" );
 
-      len = sprintf( buffer, "HTTP/1.1 200 OK\n\n" );/* send success code */
-      write( fd, buffer, len );
+  /* Move any pipelined requests to the front of the buffer */
+  if( status == HTTP_DONE ) {
+    conn->requestLength -= parser->position;
+    memmove( conn->request, conn->request + parser->position,
+             conn->requestLength );
+  }
+  httpInit( parser );
+  return resp;
+}
 
+/* This function takes a file handle to a client, reads in the request, 
+ *    parses the request, and sends back the requested file.  If the
+ *    request is improper or the file is not available, the appropriate
+ *    error is sent back.
+ * Changes for project: Instead of sending back the file, it creates an
+ * 	RCB block and adds it to the scheduler queue.
+ *    Clients may send several requests on one connection, without waiting
+ *    for the responses.  These are read up to PIPELINE_DEPTH ahead, and
+ *    their responses queued on the connection to be sent in order.
+ * Parameters: 
+ *             fd : the file descriptor to the client connection
+ * Returns: None
+ */
+static void serve_client( int fd ) {
+  struct Connection *conn = getConnection( fd );
+  struct Response *resp;
+  int status;                                       /* result of parsing */
+
+  while( !conn->closing && ( conn->numPending < PIPELINE_DEPTH ) ) {
+    status = readRequest( fd );                     /* read req from client */
+    if( status == HTTP_NEED_MORE ) {
+      break;                                        /* not all there yet */
+    } else if( status == -2 ) {                     /* client went away or */
+      conn->closing = 1;                            /* is done sending */
+      break;
     }
+
+    resp = makeResponse( fd, status );              /* queue the response */
+    if( conn->lastPending ) {
+      conn->lastPending->next = resp;
+    } else {
+      conn->firstPending = resp;
+    }
+    conn->lastPending = resp;
+    conn->numPending++;
   }
+  nextResponse( fd );
+}
 
+/* This function returns how much of a job to send in its turn.  With -Q,
+ *    it is what the client socket can take without filling up, so that a
+ *    fast client sends a lot per turn and a slow one is not tried again
+ *    until it has read some more.
+ * Parameters:
+ *             rcb : the job to send
+ * Returns: The size of the quantum, in bytes.
+ */
+static int turnQuantum( struct RequestControlBlock *rcb ) {
+  int space;
+
+  if( !maxQuantum ) {
+    return rcb->quantum;
+  }
+  space = network_send_space( rcb->fileDescriptor );
+  if( space < 0 ) {
+    return rcb->quantum;
+  }
+  return ( space < minQuantum ) ? minQuantum :
+         ( space > maxQuantum ) ? maxQuantum : space;
 }
 
-static int processNextJob(){
-	static char* buffer;
-	int len, maxRead;
+/* This function notes that a quantum of a job begins, and the end of the
+ *    time the job waited in the queue if it is its first one.  It only
+ *    uses the rcb, so that worker threads can call it.
+ * Parameters:
+ *             rcb : the job about to be sent
+ * Returns: None
+ */
+static void timeQuantum( struct RequestControlBlock *rcb ) {
+  struct request_times *times = rcb->times;
+
+  times->level = rcb->level;                        /* the last one counts */
+  if( !times->started ) {
+    times->started = latency_now();
+  }
+}
+
+/* This function starts the next io_uring transfer of the current quantum of
+ *    an rcb.  The rest of the response header is sent first.  The rcb stays
+ *    on its connection until the transfer finishes (see handleEvent).
+ * Parameters:
+ *             rcb : the job to send
+ * Returns: 1 if the transfer was started, 0 if all transfer buffers are in
+ *          use, 2 if the quantum has been sent, -1 if the transfer failed.
+ */
+static int startTransfer( struct RequestControlBlock *rcb ) {
+  struct Connection *conn = getConnection( rcb->fileDescriptor );
+  int len = conn->quantum - conn->quantumSent;      /* rest of the quantum */
+
+  if( rcb->headerSent < rcb->headerLength ) {
+    network_write( rcb->fileDescriptor, rcb->header + rcb->headerSent,
+                   rcb->headerLength - rcb->headerSent );
+  } else {
+    if( len > rcb->lengthRemaining - conn->quantumSent ) {
+      len = rcb->lengthRemaining - conn->quantumSent;
+    }
+    if( len <= 0 ) {
+      return 2;
+    } else if( rcb->cachedData ) {
+      network_write( rcb->fileDescriptor, rcb->cachedData + rcb->offset, len );
+    } else {
+      network_send_file( rcb->fileDescriptor, rcb->file, rcb->offset, len );
+    }
+  }
+  if( errno != EINPROGRESS ) {
+    return ( errno == EBUSY ) ? 0 : -1;
+  }
+  conn->sending = rcb;
+  return 1;
+}
+
+/* This function sends one quantum of a job, after what is left of its
+ *    response header, and then updates, blocks or removes the rcb.  It only
+ *    uses the rcb, so that worker threads can run it.
+ * Parameters:
+ *             rcb : the job to send
+ * Returns: JOB_QUEUED if the rcb went back in the queue, JOB_BLOCKED if it
+ *          has to wait for the socket to drain (it is not in the queue),
+ *          JOB_DONE if the response was sent and JOB_FAILED if it could not
+ *          be (in both cases the rcb was removed).
+ */
+static int runQuantum( struct RequestControlBlock *rcb ) {
+	int len, sent;
+	int quantum = turnQuantum( rcb );
+
+	timeQuantum( rcb );
+	int fd = rcb->fileDescriptor;
 	int totalLen = 0;
-	struct RequestControlBlock* rcb = getNextJob(schedType);
-	if(rcb->sequenceNumber == -1){	/*No more jobs to process*/
-		free(rcb);
-		return 0;
-	}
+	int blocked = 0;		/* socket could not take more data */
+	int failed = 0;			/* file was cut short or client went away */
 
-	if( !buffer ) {                                   /* 1st time, alloc buffer */
-    		buffer = malloc( MAX_HTTP_SIZE );
-    		if( !buffer ) {                                 /* error check */
-      			perror( "Error while allocating memory" );
-			return 1;
-    		}
+	if( rcb->headerSent < rcb->headerLength ) {	/* finish the header */
+		sent = network_write( fd, rcb->header + rcb->headerSent,
+				      rcb->headerLength - rcb->headerSent );
+		if( sent > 0 ) {
+			rcb->headerSent += sent;
+		} else if( ( errno != EAGAIN ) && ( errno != EWOULDBLOCK ) ) {
+			perror( "Error while writing to client" );
+			failed = 1;
+		}
+		blocked = !failed && ( rcb->headerSent < rcb->headerLength );
 	}
 
-  	memset( buffer, 0, MAX_HTTP_SIZE );
-
-	do {                                          /* loop, read & send file */
-		/*set maximum number of bytes to read for this pass*/
-		if ((rcb->quantum - totalLen) < MAX_HTTP_SIZE){
-			maxRead = rcb->quantum - totalLen;
+	/* The whole quantum is normally sent with one call, from memory if the
+	 * file is cached and with sendfile from rcb->offset if not. After a short
+	 * write the rest is tried once more, which returns EAGAIN if the socket
+	 * is full so that the reactor reports it when it drains. */
+	while( !blocked && !failed && (totalLen < quantum) &&
+	       (totalLen < rcb->lengthRemaining) ) {	/* loop, send the file */
+		/*set maximum number of bytes to send for this pass*/
+		len = quantum - totalLen;
+		if (len > rcb->lengthRemaining - totalLen){
+			len = rcb->lengthRemaining - totalLen;
 		}
-		else {
-			maxRead = MAX_HTTP_SIZE;
+
+		if( rcb->cachedData ) {
+			sent = network_write( fd, rcb->cachedData + rcb->offset, len );
+		} else {
+			sent = network_send_file( fd, rcb->file, rcb->offset, len );
 		}
-		len = fread( buffer, 1, maxRead, rcb->fileHandle );  /* read file chunk */
-		if( len < 0 ) {                             /* check for errors */
-			perror( "Error while writing to client" );
-		} else if( len > 0 ) {                      /* if none, send chunk */
-			len = write( rcb->fileDescriptor, buffer, len );
-			if( len < 1 ) {                           /* check for errors */
+		if( sent < 0 ) {
+			if( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) {
+				blocked = 1;                        /* socket is full */
+			} else {                                  /* check for errors */
 				perror( "Error while writing to client" );
+				failed = 1;
 			}
+			break;
+		} else if( sent == 0 ) {                    /* file got shorter */
+			failed = 1;
+			break;
 		}
-		totalLen += len;
-      	} while( (len == MAX_HTTP_SIZE) && (totalLen < rcb->quantum) );         /* the last chunk < 8192 */
-      	updateRCB(schedType, totalLen, rcb);	/*scheduler handles rcb from here*/
-      	return 1;
+		totalLen += sent;
+		rcb->offset += sent;
+	}
+
+	if( failed ) {			/* the client cannot get the whole file */
+		updateRCB(rcb->lengthRemaining, rcb);
+		return JOB_FAILED;
+	}
+	else if( blocked ) {
+		blockRCB(totalLen, rcb);	/* wait for the socket to drain */
+		return JOB_BLOCKED;
+	}
+	else if( updateRCB(totalLen, rcb) ) {	/*scheduler handles rcb from here*/
+		return JOB_DONE;
+	}
+	return JOB_QUEUED;
 }
 
+/* This function acts on the result of a quantum for the connection of the
+ *    job.  It is only called by the main thread.
+ * Parameters:
+ *             fd : the client socket
+ *             result : what runQuantum returned
+ *             rcb : the job, if it is blocked
+ * Returns: None
+ */
+static void jobFinished( int fd, int result, struct RequestControlBlock *rcb ) {
+  struct Connection *conn = getConnection( fd );
 
+  switch( result ) {
+    case JOB_BLOCKED:
+      if( conn->writable ) {                        /* drained in the meantime */
+        conn->writable = 0;
+        resumeRCB( rcb );
+        if( numWorkers ) {
+          wakeWorkers();
+        }
+      } else {
+        conn->blocked = rcb;
+      }
+      break;
+    case JOB_DONE:
+      finishResponse( fd, 1 );
+      break;
+    case JOB_FAILED:
+      finishResponse( fd, 0 );
+      break;
+  }
+}
+
+/* This function runs a quantum of a job on a worker thread, and passes the
+ *    result back to the main thread if the connection has to know about it.
+ * Parameters:
+ *             rcb : the job to send
+ * Returns: None
+ */
+static void workerJob( struct RequestControlBlock *rcb ) {
+  struct Completion *done;
+  int fd = rcb->fileDescriptor;
+  int result = runQuantum( rcb );
+  uint64_t one = 1;
+
+  if( result == JOB_QUEUED ) {
+    return;
+  }
+  done = pool_alloc( completionPool );
+  if( !done ) {
+    perror( "Error while allocating memory" );
+    abort();
+  }
+  done->next = NULL;
+  done->fd = fd;
+  done->result = result;
+  done->rcb = ( result == JOB_BLOCKED ) ? rcb : NULL;
+
+  pthread_mutex_lock( &completionLock );
+  if( lastCompletion ) {
+    lastCompletion->next = done;
+  } else {
+    firstCompletion = done;
+  }
+  lastCompletion = done;
+  pthread_mutex_unlock( &completionLock );
+  write( completionFd, &one, sizeof( one ) );      /* wake the main thread */
+}
+
+/* This function handles the jobs the workers have finished or blocked
+ *    since it was last called.
+ * Parameters: None
+ * Returns: None
+ */
+static void handleCompletions() {
+  struct Completion *done;
+  uint64_t count;
+
+  read( completionFd, &count, sizeof( count ) );   /* reset the eventfd */
+  pthread_mutex_lock( &completionLock );
+  done = firstCompletion;
+  firstCompletion = lastCompletion = NULL;
+  pthread_mutex_unlock( &completionLock );
+
+  while( done ) {
+    struct Completion *next = done->next;
+
+    jobFinished( done->fd, done->result, done->rcb );
+    pool_free( completionPool, done );
+    done = next;
+  }
+}
+
+/* This function sends the next quantum of the next job in the queue.
+ *    If the client socket fills up before the quantum is used, the rcb is
+ *    parked on its connection until the socket becomes writable again.
+ * Parameters: None
+ * Returns: 1 if a job was processed, 0 if the queue is empty.
+ */
+static int processNextJob(){
+	int fd;
+	struct Connection *conn;
+	struct RequestControlBlock* rcb = noBuffer;
+	if(rcb == NULL){
+		rcb = getNextJob(&scheduler);
+	}
+	if(rcb == NULL){		/*No more jobs to process*/
+		return 0;
+	}
+	fd = rcb->fileDescriptor;
+	conn = getConnection( fd );
+
+	if( network_backend() == NETWORK_URING ) {	/* queue the quantum */
+		noBuffer = NULL;
+		timeQuantum( rcb );
+		conn->quantum = turnQuantum( rcb );
+		conn->quantumSent = 0;
+		switch( startTransfer( rcb ) ) {
+		case 1:
+			blockRCB(0, rcb);	/* until the transfer is done */
+			return 1;
+		case 0:
+			noBuffer = rcb;			/* first in line for a buffer */
+			return 0;
+		case 2:
+			if( updateRCB(0, rcb) ) {	/* nothing to send */
+				finishResponse( fd, 1 );
+			}
+			return 1;
+		default:
+			perror( "Error while writing to client" );
+			updateRCB(rcb->lengthRemaining, rcb);
+			finishResponse( fd, 0 );
+			return 1;
+		}
+	}
+
+	jobFinished( fd, runQuantum( rcb ), rcb );
+	return 1;
+}
+
+
+/* This function handles the events the network module reported for a
+ *    client socket.  A finished io_uring transfer continues the quantum, a
+ *    writable socket has its blocked rcb put back in the queue, and a
+ *    readable socket has its requests read.  Completions from the workers
+ *    are handled here too.
+ * Parameters:
+ *             fd : the client socket
+ *             events : the events reported by network_next()
+ * Returns: None
+ */
+static void handleEvent( int fd, int events ) {
+  struct Connection *conn;
+  struct RequestControlBlock *rcb;
+  int len;
+
+  if( fd == completionFd ) {                        /* workers are done */
+    handleCompletions();
+    return;
+  }
+  conn = getConnection( fd );
+
+  if( conn->sending && ( events & NETWORK_WRITE ) ) {
+    rcb = conn->sending;                            /* transfer finished */
+    conn->sending = NULL;
+    len = network_sent( fd );
+    if( len <= 0 ) {                                /* end of file or error */
+      if( len < 0 ) {
+        perror( "Error while writing to client" );
+      }
+      updateRCB( rcb->lengthRemaining, rcb );
+      finishResponse( fd, 0 );
+      return;
+    }
+
+    if( rcb->headerSent < rcb->headerLength ) {
+      rcb->headerSent += len;
+    } else {
+      rcb->offset += len;
+      conn->quantumSent += len;
+    }
+    switch( startTransfer( rcb ) ) {
+      case 1:                                       /* quantum goes on */
+        return;
+      case 0:                                       /* wait for a buffer */
+        blockRCB( conn->quantumSent, rcb );
+        resumeRCB( rcb );
+        return;
+      case -1:
+        perror( "Error while writing to client" );
+        updateRCB( rcb->lengthRemaining, rcb );
+        finishResponse( fd, 0 );
+        return;
+    }
+    if( updateRCB( conn->quantumSent, rcb ) ) {
+      finishResponse( fd, 1 );
+    }
+  } else if( events & ( NETWORK_WRITE | NETWORK_HANGUP ) ) {
+    if( conn->blocked ) {
+      resumeRCB( conn->blocked );        /* socket drained or died */
+      conn->blocked = NULL;
+      if( numWorkers ) {
+        wakeWorkers();
+      }
+    } else if( conn->current ) {
+      conn->writable = 1;                           /* a worker may block soon */
+    }
+  }
+
+  if( conn->open && ( events & ( NETWORK_READ | NETWORK_HANGUP ) ) ) {
+    serve_client( fd );                             /* requests have arrived */
+  }
+}
+
+
+/* This function notes the signals that ask for the statistics, which main()
+ *    prints once the signal has woken it up.
+ * Parameters:
+ *             sig : the signal
+ * Returns: None
+ */
+static void onSignal( int sig ) {
+  if( sig == SIGUSR1 ) {
+    reportWanted = 1;
+  } else {
+    exitWanted = 1;
+  }
+}
+
+
+/* This function parses a comma separated list of quanta in kilobytes.
+ * Parameters: 
+ *             list : the list, as given on the command line
+ *             quanta : array of MAX_LEVELS quanta, in bytes
+ * Returns: the number of quanta, or -1 if the list is not valid.
+ */
+static int parseQuanta( char *list, int *quanta ) {
+  int levels = 0;
+  long kbytes;
+  char *end;
+
+  do {
+    kbytes = strtol( list, &end, 10 );
+    if( ( end == list ) || ( kbytes < 1 ) || ( kbytes > INT_MAX / 1024 ) ||
+        ( levels == MAX_LEVELS ) || ( ( *end != ',' ) && ( *end != '\0' ) ) ) {
+      return -1;
+    }
+    quanta[levels++] = kbytes * 1024;
+    list = end + 1;
+  } while( *end == ',' );
+  return levels;
+}
+
+
+/* This function gives a client a weight for fair scheduling.
+ * Parameters: 
+ *             arg : the address and the weight, as given on the command line
+ * Returns: 0 on success, -1 if arg is not valid.
+ */
+static int parseWeight( char *arg ) {
+  struct in_addr addr;
+  char *weight = strchr( arg, ':' );
+
+  if( !weight ) {
+    return -1;
+  }
+  *weight++ = '\0';
+  if( inet_pton( AF_INET, arg, &addr ) != 1 ) {
+    return -1;
+  }
+  return setClientWeight( ntohl( addr.s_addr ), atoi( weight ) );
+}
 
 
 /* This function is where the program starts running.
  *    The function first parses its command line parameters to determine port #
  *    Then, it initializes, the network and enters the main loop.
- *    The main loop waits for a client (1 or more to connect, and then processes
- *    all clients by calling the seve_client() function for each one.
+ *    The main loop waits for network events, accepts any new clients, reads
+ *    the requests of clients whose sockets became readable (see serve_client),
+ *    resumes jobs whose sockets became writable, and then runs the next
+ *    QUANTA_PER_POLL quanta of the jobs in the queue.  While jobs are
+ *    waiting it only checks for events without sleeping, so that new
+ *    clients and requests are taken in between quanta, and a new job with
+ *    a higher priority runs at the next quantum instead of after all the
+ *    queued work.
+ *    While clients are connected, it wakes up at least once a second to close
+ *    connections that have been idle for too long.
+ *    SIGUSR1 makes it print the cache statistics, and SIGINT or SIGTERM
+ *    print them and stop the server.
  * Parameters: 
  *             argc : number of command line parameters (including program name
  *             argv : array of pointers to command line parameters
@@ -152,35 +987,190 @@ static int processNextJob(){
 int main( int argc, char **argv ) {
   int port = -1;                                    /* server port # */
   int fd;                                           /* client file descriptor */
+  int events;                                       /* client socket events */
+  int listeners = -1;                               /* SO_REUSEPORT sockets */
+  int backlog = NETWORK_BACKLOG;                    /* accept queue length */
+  int defer = 0;                                    /* TCP_DEFER_ACCEPT secs */
+  int opt;
+  int uring = 0;                                    /* try io_uring */
+  int workers = 0;                                  /* worker threads */
+  int cacheSize = CACHE_KBYTES;                     /* file cache size */
+  int jobs;                                         /* rcbs the queues hold */
+  int budget;                                       /* clients to accept */
+  int turn;                                         /* quanta run since the last poll */
+  char *policy = NULL;                              /* cache policy */
+  char *schedType;                                  /* SJF, SRPT, RR or MLFB */
+  int quanta[MAX_LEVELS];                           /* of each queue level */
+  int levels = 0;                                   /* 0 for the defaults */
+  int aging = SRPT_AGING;                           /* percent */
+  int fairness = 0;                                 /* kbytes, 0 for none */
+  int badWeight = 0;                                /* -W was not valid */
+  int requests = 0;                                 /* -r, 0 for the default */
+  int kbytes = 0;
+  struct sigaction action;
+  sigset_t reportSignals;
+  time_t now;
+  time_t lastSweep = 0;                             /* last idle check */
 
   /* check for and process parameters 
-   * port number and scheduler
+   * port number and scheduler, then the options
    */
   if( ( argc < 3 ) || ( sscanf( argv[1], "%d", &port ) < 1 )) {
-    printf( "usage: sms <port> <scheduler>\n" );
+    printf( USAGE );
     return 0;
   }
   schedType = argv[2];
+
+  optind = 3;
+  while( ( opt = getopt( argc, argv, "l:b:d:k:uw:c:mp:q:a:f:W:Q:r:" ) ) != -1 ) {
+    switch( opt ) {
+      case 'l': listeners = atoi( optarg ); break;
+      case 'b': backlog = atoi( optarg ); break;
+      case 'd': defer = atoi( optarg ); break;
+      case 'k': keepAliveTimeout = atoi( optarg ); break;
+      case 'u': uring = 1; break;
+      case 'w': workers = atoi( optarg ); break;
+      case 'c': cacheSize = atoi( optarg ); break;
+      case 'm': cache_use_mmap( 1 ); break;
+      case 'p': policy = optarg; break;
+      case 'q': levels = parseQuanta( optarg, quanta ); break;
+      case 'a': aging = atoi( optarg ); break;
+      case 'f': fairness = atoi( optarg ); break;
+      case 'W': badWeight |= parseWeight( optarg ); break;
+      case 'r':
+        if( sscanf( optarg, "%d,%d", &requests, &kbytes ) < 1 ) {
+          requests = -1;
+        }
+        break;
+      case 'Q':
+        if( sscanf( optarg, "%d,%d", &minQuantum, &maxQuantum ) < 2 ) {
+          maxQuantum = -1;
+        }
+        break;
+      default:
+        printf( USAGE );
+        return 0;
+    }
+  }
+  if( listeners == -1 ) {                           /* one per worker */
+    listeners = ( workers > 0 ) ? workers : 1;
+  }
+  if( ( listeners < 1 ) || ( listeners > NETWORK_MAX_LISTEN ) || ( backlog < 1 ) ||
+      ( workers < 0 ) || ( workers > MAX_WORKERS ) ||
+      ( cacheSize < 0 ) || ( cacheSize > INT_MAX / 1024 ) || ( levels < 0 ) ||
+      setAging( aging ) || badWeight || ( fairness < 0 ) || ( fairness > INT_MAX / 1024 ) ||
+      ( maxQuantum && ( ( minQuantum < 1 ) || ( maxQuantum < minQuantum ) ||
+                        ( maxQuantum > INT_MAX / 1024 ) ) ) ||
+      ( requests < 0 ) || ( kbytes < 0 ) ) {
+    printf( USAGE );
+    return 0;
+  }
+  minQuantum *= 1024;
+  maxQuantum *= 1024;
  
   /*for testing*/
   if(strcmp(schedType, "test") == 0){
 	
 	return 0;
   }
-  if((strcmp(schedType, "SJF") != 0) && (strcmp(schedType, "RR") != 0) && (strcmp(schedType, "MLFB") != 0)){
-    printf( "usage: schedule type must be SJF, RR, MLFB or else 'test' for testing\n" );
+  if( setScheduler( schedType, levels ? quanta : NULL, levels ) ) {
+    printf( "usage: schedule type must be SJF, SRPT, RR, MLFB or else 'test' for testing\n" );
     return 0;
   }   
+  if( fairness && setFairness( fairness * 1024 ) ) {
+    printf( "usage: -f only works with RR and MLFB\n" );
+    return 0;
+  }
 
-  network_init( port );                             /* init network module */
+  signal( SIGPIPE, SIG_IGN );                       /* report EPIPE instead */
+  memset( &action, 0, sizeof( action ) );
+  action.sa_handler = onSignal;                     /* without SA_RESTART, */
+  sigaction( SIGUSR1, &action, NULL );              /* so that the signals */
+  sigaction( SIGINT, &action, NULL );               /* wake up network_wait */
+  sigaction( SIGTERM, &action, NULL );
+  if( uring && workers ) {
+    printf( "io_uring transfers run on the main thread, not using workers\n" );
+    workers = 0;
+  }
+  if( uring ) {
+    network_set_backend( NETWORK_URING );
+  }
+  network_init_listeners( port, listeners, backlog, defer ); /* init network */
+
+  if( cache_init( cacheSize * 1024, policy ) ) {
+    printf( USAGE );
+    return 0;
+  }
+  if( cache_watch( "." ) < 0 ) {                    /* resolve paths in memory */
+    perror( "Error while watching files, looking each one up" );
+  }
+  initScheduler( &scheduler );
+  jobs = requests ? requests : RCB_QUEUE_SIZE * ( workers ? workers : 1 );
+  maxAdmitted = jobs;                               /* size the pools for */
+  maxAdmittedBytes = kbytes * 1024LL;
+  setQueueBound( jobs );                            /* any worker may get all */
+  responsePool = pool_create( "responses", sizeof( struct Response ), jobs ); /* full queues */
+  completionPool = pool_create( "completions", sizeof( struct Completion ), workers ? jobs : 0 );
+  if( initRcbPool( jobs ) || !responsePool || !completionPool ) {
+    perror( "Error while allocating memory" );
+    return 1;
+  }
+  if( workers ) {                                   /* start the pool */
+    sigemptyset( &reportSignals );                  /* with the signals only */
+    sigaddset( &reportSignals, SIGUSR1 );           /* going to this thread */
+    sigaddset( &reportSignals, SIGINT );
+    sigaddset( &reportSignals, SIGTERM );
+    pthread_sigmask( SIG_BLOCK, &reportSignals, NULL );
+    completionFd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if( ( completionFd < 0 ) || network_watch( completionFd ) ||
+        startWorkers( workers, workerJob ) ) {
+      perror( "Error while starting workers" );
+      return 1;
+    }
+    pthread_sigmask( SIG_UNBLOCK, &reportSignals, NULL );
+    numWorkers = workers;
+  }
 
   for( ;; ) {                                       /* main loop */
-    network_wait();                                 /* wait for clients */
+    if( !numWorkers && !noBuffer && hasJobs( &scheduler ) ) {
+      network_poll( 0 );                            /* look, then run more */
+    } else if( ( keepAliveTimeout > 0 ) && openConnections ) {
+      network_poll( 1000 );                         /* wait, but not forever */
+    } else {
+      network_wait();                               /* wait for events */
+    }
+    cache_changes();                                /* before serving requests */
+    if( reportWanted || exitWanted ) {              /* print the statistics */
+      reportWanted = 0;
+      cache_report( stdout );
+      pool_report( stdout );
+      printf( "Admission: %d responses with %lld bytes queued, %ld turned away\n",
+              admitted, admittedBytes, rejected );
+      latency_report( stdout );
+      fflush( stdout );
+      if( exitWanted ) {
+        return 0;
+      }
+    }
+
+    for( budget = acceptBudget(); budget > 0; budget-- ) { /* get clients */
+      fd = network_open( budget );
+      if( fd < 0 ) {
+        break;
+      }
+      resetConnection( fd );
+    }
+    for( fd = network_next( &events ); fd >= 0; fd = network_next( &events ) ) {
+      handleEvent( fd, events );                    /* process each event */
+    }
+    if( !numWorkers ) {                             /* run the rcbs in the queue */
+      for( turn = 0; ( turn < QUANTA_PER_POLL ) && processNextJob(); turn++ );
+    }
 
-    for( fd = network_open(); fd >= 0; fd = network_open() ) { /* get clients */
-      serve_client( fd );                           /* process each client */
+    now = time( NULL );
+    if( ( keepAliveTimeout > 0 ) && ( now != lastSweep ) ) {
+      closeIdleConnections( now );                  /* drop idle clients */
+      lastSweep = now;
     }
-    while(processNextJob());			    /* process the rcbs in the queue */
-    
   }
 }
@@ -0,0 +1,109 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "worker.h"
+
+/* A worker thread and the scheduler it takes its jobs from */
+struct Worker {
+	pthread_t thread;
+	int index;			/* position in the pool */
+	struct Scheduler scheduler;
+};
+
+static struct Worker workers[MAX_WORKERS];
+static int numWorkers = 0;
+static int nextWorker = 0;		/* gets the next new job */
+static JobFunction runJob;		/* runs one quantum of a job */
+
+static pthread_mutex_t idleLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workAvailable = PTHREAD_COND_INITIALIZER;
+static int numIdle = 0;			/* workers waiting for jobs */
+
+/* This function finds a job for a worker, first in its own queues, then
+ * in the queues of the other workers, starting with the next one.
+ */
+static struct RequestControlBlock* findJob(struct Worker *worker){
+	struct RequestControlBlock *rcb = getNextJob(&worker->scheduler);
+	int i;
+
+	for (i = 1; (rcb == NULL) && (i < numWorkers); i++){
+		rcb = stealJob(&worker->scheduler,
+			&workers[(worker->index + i) % numWorkers].scheduler);
+	}
+	return rcb;
+}
+
+/* This function returns 1 if any worker has jobs waiting.
+ */
+static int anyJobs(){
+	int i;
+
+	for (i = 0; i < numWorkers; i++){
+		if (hasJobs(&workers[i].scheduler)){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void* workerMain(void *arg){
+	struct Worker *worker = arg;
+	struct RequestControlBlock *rcb;
+
+	for (;;){
+		rcb = findJob(worker);
+		if (rcb != NULL){
+			runJob(rcb);
+			continue;
+		}
+
+		/* Jobs are added before wakeWorkers takes idleLock, so checking
+		 * with the lock held cannot miss a wake up. */
+		pthread_mutex_lock(&idleLock);
+		while (!anyJobs()){
+			numIdle++;
+			pthread_cond_wait(&workAvailable, &idleLock);
+			numIdle--;
+		}
+		pthread_mutex_unlock(&idleLock);
+	}
+	return NULL;
+}
+
+extern int startWorkers(int num, JobFunction function){
+	int i;
+
+	if ((num < 1) || (num > MAX_WORKERS)){
+		return -1;
+	}
+	runJob = function;
+	for (i = 0; i < num; i++){
+		workers[i].index = i;
+		initScheduler(&workers[i].scheduler);
+	}
+	numWorkers = num;
+	for (i = 0; i < num; i++){
+		if (pthread_create(&workers[i].thread, NULL, workerMain, &workers[i]) != 0){
+			perror("Error while starting worker");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+extern struct Scheduler* nextWorkerScheduler(){
+	struct Scheduler *sched = &workers[nextWorker].scheduler;
+
+	nextWorker = (nextWorker + 1) % numWorkers;
+	return sched;
+}
+
+extern void wakeWorkers(){
+	pthread_mutex_lock(&idleLock);
+	if (numIdle > 0){
+		pthread_cond_signal(&workAvailable);
+	}
+	pthread_mutex_unlock(&idleLock);
+}
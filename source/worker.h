@@ -0,0 +1,36 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include "scheduler.h"
+
+/* This is a pool of worker threads that run the jobs of the scheduler.
+ * Each worker owns a scheduler with its own queues, so the scheduling
+ * policy holds within each worker. New jobs are handed to the workers in
+ * turn, and a worker that runs out of jobs steals the next job of another
+ * worker before going to sleep.
+ */
+
+#define MAX_WORKERS	64		/* most worker threads in the pool */
+
+/* The function a worker calls to run one quantum of a job. It gets the
+ * job's scheduler through rcb->scheduler, and must update, block or
+ * remove the RCB like the single threaded server does.
+ */
+typedef void (*JobFunction)(struct RequestControlBlock *rcb);
+
+/* This function starts num workers that run their jobs with runJob, in
+ * the order of the scheduler chosen with setScheduler. It returns 0 on
+ * success, -1 on failure.
+ */
+extern int startWorkers(int num, JobFunction runJob);
+
+/* This function returns the scheduler that should get the next new job.
+ */
+extern struct Scheduler* nextWorkerScheduler();
+
+/* This function wakes a sleeping worker after jobs were added to a
+ * scheduler from outside the pool, with createRCB or resumeRCB.
+ */
+extern void wakeWorkers();
+
+#endif